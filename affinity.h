@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// Where producers and async workers run. compact packs them onto neighbouring cores of
+// one NUMA node (SMT siblings last), spread deals them round-robin over nodes and
+// physical cores, and cross-socket keeps producers on the first node and the backend's
+// workers on the last, so every record crosses the interconnect.
+enum affinity_mode { affinity_none, affinity_compact, affinity_spread, affinity_cross_socket };
+
+affinity_mode parse_affinity_mode(const std::string &name) {
+    if (name == "none")
+        return affinity_none;
+    if (name == "compact")
+        return affinity_compact;
+    if (name == "spread")
+        return affinity_spread;
+    if (name == "cross-socket")
+        return affinity_cross_socket;
+    throw std::runtime_error("Unknown pinning mode: " + name);
+}
+
+const char *affinity_mode_name(affinity_mode mode) {
+    switch (mode) {
+    case affinity_compact: return "compact";
+    case affinity_spread: return "spread";
+    case affinity_cross_socket: return "cross-socket";
+    default: return "none";
+    }
+}
+
+struct cpu_info {
+    int cpu;
+    int node;    // NUMA node, or the physical package where the kernel has no NUMA info
+    int core;    // physical core within the package; SMT siblings share it
+};
+
+#if defined(__linux__)
+int read_sysfs_int(const std::string &path, int fallback) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        return fallback;
+    int value = fallback;
+    if (fscanf(f, "%d", &value) != 1)
+        value = fallback;
+    fclose(f);
+    return value;
+}
+#endif
+
+// The CPUs this process may run on, from sched_getaffinity and sysfs
+const std::vector<cpu_info> &cpu_topology() {
+    static std::vector<cpu_info> cpus = [] {
+        std::vector<cpu_info> result;
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        sched_getaffinity(0, sizeof(allowed), &allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+            cpu_info info;
+            info.cpu = cpu;
+            info.core = read_sysfs_int(dir + "/topology/core_id", cpu);
+            info.node = read_sysfs_int(dir + "/topology/physical_package_id", 0);
+            if (DIR *d = opendir(dir.c_str())) {
+                while (struct dirent *entry = readdir(d))
+                    if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4]))
+                        info.node = atoi(entry->d_name + 4);
+                closedir(d);
+            }
+            result.push_back(info);
+        }
+#endif
+        if (result.empty())
+            for (int cpu = 0; cpu < int(std::max(std::thread::hardware_concurrency(), 1u)); cpu++)
+                result.push_back(cpu_info{cpu, 0, cpu});
+        return result;
+    }();
+    return cpus;
+}
+
+int numa_node_count() {
+    std::set<int> nodes;
+    for (auto &info : cpu_topology())
+        nodes.insert(info.node);
+    return int(nodes.size());
+}
+
+// All allowed CPUs in the order a mode hands them out
+std::vector<cpu_info> cpu_order(affinity_mode mode) {
+    std::vector<cpu_info> cpus = cpu_topology();
+    std::sort(cpus.begin(), cpus.end(), [](const cpu_info &a, const cpu_info &b) {
+        return a.node != b.node ? a.node < b.node : a.core != b.core ? a.core < b.core : a.cpu < b.cpu;
+    });
+    // Index of each CPU among its core's SMT siblings
+    std::vector<int> sibling(cpus.size(), 0);
+    for (size_t i = 1; i < cpus.size(); i++)
+        if (cpus[i].node == cpus[i - 1].node && cpus[i].core == cpus[i - 1].core)
+            sibling[i] = sibling[i - 1] + 1;
+
+    std::vector<size_t> index(cpus.size());
+    for (size_t i = 0; i < index.size(); i++)
+        index[i] = i;
+    if (mode == affinity_spread) {
+        // Round-robin over nodes: the k-th physical core of every node before the (k+1)-th
+        std::vector<int> rank(cpus.size(), 0);
+        for (size_t i = 0, k = 0; i < cpus.size(); i++) {
+            if (i > 0 && cpus[i].node != cpus[i - 1].node)
+                k = 0;
+            if (sibling[i] == 0)
+                rank[i] = int(k++);
+        }
+        for (size_t i = 1; i < cpus.size(); i++)
+            if (sibling[i] > 0)
+                rank[i] = rank[i - 1];
+        std::stable_sort(index.begin(), index.end(), [&](size_t a, size_t b) {
+            return sibling[a] != sibling[b] ? sibling[a] < sibling[b] : rank[a] != rank[b] ? rank[a] < rank[b] : cpus[a].node < cpus[b].node;
+        });
+    }
+    else {
+        // Node by node, physical cores before their SMT siblings
+        std::stable_sort(index.begin(), index.end(), [&](size_t a, size_t b) {
+            return cpus[a].node != cpus[b].node ? cpus[a].node < cpus[b].node : sibling[a] < sibling[b];
+        });
+    }
+
+    std::vector<cpu_info> order;
+    for (size_t i : index)
+        order.push_back(cpus[i]);
+    return order;
+}
+
+// CPUs for the producers and the backend's worker threads under a mode; empty when unpinned.
+// Workers follow the producers in the same order, wrapping around when the machine is full.
+struct thread_placement {
+    std::vector<int> producers;
+    std::vector<int> workers;
+};
+
+thread_placement place_threads(affinity_mode mode, int producers, int workers) {
+    thread_placement placement;
+    if (mode == affinity_none)
+        return placement;
+
+    std::vector<cpu_info> order = cpu_order(mode);
+    if (mode == affinity_cross_socket) {
+        int first = order.front().node, last = order.back().node;
+        std::vector<int> near, far;
+        for (auto &c : order) {
+            if (c.node == first)
+                near.push_back(c.cpu);
+            if (c.node == last)
+                far.push_back(c.cpu);
+        }
+        // With a single node, workers take the CPUs furthest from the producers
+        if (first == last)
+            std::reverse(far.begin(), far.end());
+        for (int i = 0; i < producers; i++)
+            placement.producers.push_back(near[size_t(i) % near.size()]);
+        for (int i = 0; i < workers; i++)
+            placement.workers.push_back(far[size_t(i) % far.size()]);
+        return placement;
+    }
+    for (int i = 0; i < producers; i++)
+        placement.producers.push_back(order[size_t(i) % order.size()].cpu);
+    for (int i = 0; i < workers; i++)
+        placement.workers.push_back(order[size_t(producers + i) % order.size()].cpu);
+    return placement;
+}
+
+// Pins a thread (0 = the calling one) to a single CPU; false where unsupported
+bool pin_thread(int tid, int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (tid == 0)
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    return sched_setaffinity(tid, sizeof(set), &set) == 0;
+#else
+    return false;    // macOS only has affinity hints
+#endif
+}
+
+// Kernel ids of the process's threads, to find the ones a backend started in setup()
+std::vector<int> thread_ids() {
+    std::vector<int> ids;
+#if defined(__linux__)
+    if (DIR *dir = opendir("/proc/self/task")) {
+        while (struct dirent *entry = readdir(dir))
+            if (entry->d_name[0] != '.')
+                ids.push_back(atoi(entry->d_name));
+        closedir(dir);
+    }
+    std::sort(ids.begin(), ids.end());
+#endif
+    return ids;
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+// Heap accounting for --alloc. The global operator new/delete below count every C++
+// allocation; on glibc malloc and friends are interposed as well, which catches C code
+// and libraries that bypass operator new. Counts are thread-local and folded into the
+// process totals in batches, so the hot path never touches a shared cache line.
+
+// Set once before any benchmark thread starts
+bool alloc_counting = false;
+
+struct alloc_snapshot {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;    // requested bytes
+};
+
+// Plain data so that thread_local needs no constructor, destructor or allocation of its own
+struct alloc_thread_counts {
+    uint64_t allocations, frees, bytes;
+    uint64_t flushed_allocations, flushed_frees, flushed_bytes;
+    int64_t live_delta;    // usable bytes allocated minus freed, not yet folded into alloc_live_bytes
+    uint32_t pending;
+};
+
+thread_local alloc_thread_counts alloc_local;
+std::atomic<uint64_t> alloc_allocations{0}, alloc_frees{0}, alloc_bytes{0};
+std::atomic<int64_t> alloc_live_bytes{0}, alloc_peak_live_bytes{0};
+
+// Peak live heap is only as exact as this batch: up to this many bytes per thread may be
+// unaccounted when the peak is sampled
+const int64_t alloc_flush_bytes = 64 * 1024;
+const uint32_t alloc_flush_events = 64;
+
+inline void alloc_flush(alloc_thread_counts &c) {
+    alloc_allocations.fetch_add(c.allocations - c.flushed_allocations, std::memory_order_relaxed);
+    alloc_frees.fetch_add(c.frees - c.flushed_frees, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(c.bytes - c.flushed_bytes, std::memory_order_relaxed);
+    c.flushed_allocations = c.allocations;
+    c.flushed_frees = c.frees;
+    c.flushed_bytes = c.bytes;
+
+    int64_t live = alloc_live_bytes.fetch_add(c.live_delta, std::memory_order_relaxed) + c.live_delta;
+    int64_t peak = alloc_peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !alloc_peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    c.live_delta = 0;
+    c.pending = 0;
+}
+
+inline size_t alloc_usable_size(void *p) {
+#if defined(__GLIBC__)
+    return malloc_usable_size(p);
+#elif defined(__APPLE__)
+    return malloc_size(p);
+#else
+    return 0;
+#endif
+}
+
+inline void alloc_on_alloc(void *p, size_t size) {
+    if (!alloc_counting || !p)
+        return;
+    alloc_thread_counts &c = alloc_local;
+    c.allocations++;
+    c.bytes += size;
+    c.live_delta += int64_t(alloc_usable_size(p));
+    if (++c.pending >= alloc_flush_events || c.live_delta >= alloc_flush_bytes)
+        alloc_flush(c);
+}
+
+// A free of a block whose usable size was read before it was released
+inline void alloc_on_free_usable(size_t usable) {
+    if (!alloc_counting)
+        return;
+    alloc_thread_counts &c = alloc_local;
+    c.frees++;
+    c.live_delta -= int64_t(usable);
+    if (++c.pending >= alloc_flush_events || c.live_delta <= -alloc_flush_bytes)
+        alloc_flush(c);
+}
+
+inline void alloc_on_free(void *p) {
+    if (!alloc_counting || !p)
+        return;
+    alloc_on_free_usable(alloc_usable_size(p));
+}
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+extern "C" void *__libc_memalign(size_t, size_t);
+extern "C" void __libc_free(void *);
+
+inline void *alloc_real_malloc(size_t size) { return __libc_malloc(size); }
+inline void alloc_real_free(void *p) { __libc_free(p); }
+#else
+inline void *alloc_real_malloc(size_t size) { return malloc(size); }
+inline void alloc_real_free(void *p) { free(p); }
+#endif
+
+inline void *alloc_counted_new(size_t size) {
+    void *p = alloc_real_malloc(size ? size : 1);
+    alloc_on_alloc(p, size);
+    return p;
+}
+
+inline void alloc_counted_delete(void *p) {
+    alloc_on_free(p);
+    alloc_real_free(p);
+}
+
+#if defined(__GLIBC__)
+// Defined in the executable, these replace glibc's entry points for every shared library.
+// They forward to the __libc_* implementations, so no dlsym bootstrap is needed.
+extern "C" void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    alloc_on_alloc(p, size);
+    return p;
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    alloc_on_alloc(p, n * size);
+    return p;
+}
+
+// A failed realloc leaves the old block alone and counts as nothing; realloc(p, 0)
+// that returns null freed p
+extern "C" void *realloc(void *old, size_t size) {
+    size_t old_usable = old && alloc_counting ? alloc_usable_size(old) : 0;
+    void *p = __libc_realloc(old, size);
+    if (old && (p || size == 0))
+        alloc_on_free_usable(old_usable);
+    alloc_on_alloc(p, size);
+    return p;
+}
+
+extern "C" void free(void *p) {
+    alloc_on_free(p);
+    __libc_free(p);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+    void *p = __libc_memalign(alignment, size);
+    alloc_on_alloc(p, size);
+    return p;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *p = memalign(alignment, size);
+    if (!p)
+        return ENOMEM;
+    *out = p;
+    return 0;
+}
+#endif
+
+void *operator new(size_t size) {
+    void *p = alloc_counted_new(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return alloc_counted_new(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return alloc_counted_new(size);
+}
+
+void operator delete(void *p) noexcept {
+    alloc_counted_delete(p);
+}
+
+void operator delete[](void *p) noexcept {
+    alloc_counted_delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    alloc_counted_delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    alloc_counted_delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    alloc_counted_delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    alloc_counted_delete(p);
+}
+
+// Counts of the calling thread alone; exact, since nothing is pending from other threads
+alloc_snapshot thread_alloc_snapshot() {
+    const alloc_thread_counts &c = alloc_local;
+    alloc_snapshot snap;
+    snap.allocations = c.allocations;
+    snap.frees = c.frees;
+    snap.bytes = c.bytes;
+    return snap;
+}
+
+// Process totals. Live threads may still hold up to one unflushed batch each.
+alloc_snapshot process_alloc_snapshot() {
+    alloc_flush(alloc_local);
+    alloc_snapshot snap;
+    snap.allocations = alloc_allocations.load();
+    snap.frees = alloc_frees.load();
+    snap.bytes = alloc_bytes.load();
+    return snap;
+}
+
+// Restarts the peak-live-heap watermark at the current live heap, which is returned
+int64_t reset_peak_live_heap() {
+    alloc_flush(alloc_local);
+    int64_t live = alloc_live_bytes.load();
+    alloc_peak_live_bytes.store(live);
+    return live;
+}
+
+int64_t peak_live_heap() {
+    alloc_flush(alloc_local);
+    return alloc_peak_live_bytes.load();
+}
+
+// Folds the calling thread's pending counts into the process totals, e.g. before it exits
+void flush_thread_alloc_counts() {
+    alloc_flush(alloc_local);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+
+// When producers send. arrival_closed is the classic "as fast as possible" loop; the
+// others are open-loop schedules whose latency is measured from each record's intended
+// send time, so a stalled logger cannot hide the queueing delay it causes.
+enum arrival_kind { arrival_closed, arrival_constant, arrival_poisson, arrival_trace };
+
+struct arrival_spec {
+    arrival_kind kind = arrival_closed;
+    // Total records/sec across all producers, for constant and poisson
+    double rate = 100000;
+    uint32_t seed = 42;
+    // Replayed send times in ns after the start, for trace
+    std::vector<uint64_t> trace_ns;
+    std::string trace_file;
+};
+
+// Reads a burst trace: one "<time_us> [count]" pair per line, count defaulting to 1
+std::vector<uint64_t> load_arrival_trace(const std::string &path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Failed to open arrival trace " + path);
+    std::vector<uint64_t> times;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        char *end = nullptr;
+        double time_us = strtod(line.c_str(), &end);
+        long count = strtol(end, nullptr, 10);
+        for (long i = 0; i < std::max(count, 1L); i++)
+            times.push_back(uint64_t(time_us * 1000));
+    }
+    if (times.empty())
+        throw std::runtime_error("Arrival trace " + path + " is empty");
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+// Applies an --arrival / --rate option; false if arg is not one
+bool parse_arrival_option(const std::string &arg, arrival_spec &spec) {
+    if (arg == "--arrival=closed")
+        spec.kind = arrival_closed;
+    else if (arg == "--arrival=constant")
+        spec.kind = arrival_constant;
+    else if (arg == "--arrival=poisson")
+        spec.kind = arrival_poisson;
+    else if (arg.rfind("--arrival=trace:", 0) == 0) {
+        spec.kind = arrival_trace;
+        spec.trace_file = arg.substr(16);
+        spec.trace_ns = load_arrival_trace(spec.trace_file);
+    }
+    else if (arg.rfind("--rate=", 0) == 0) {
+        spec.rate = atof(arg.c_str() + 7);
+        if (!(spec.rate > 0))
+            throw std::runtime_error("--rate must be a positive number of records/sec");
+    }
+    else
+        return false;
+    return true;
+}
+
+const char *arrival_kind_name(arrival_kind kind) {
+    switch (kind) {
+    case arrival_constant: return "constant";
+    case arrival_poisson: return "poisson";
+    case arrival_trace: return "trace";
+    default: return "closed";
+    }
+}
+
+// Per-producer schedule. Producer t of n gets every n-th arrival of the global schedule,
+// so the aggregate rate does not depend on the number of producers.
+class arrival_generator {
+public:
+    arrival_generator(const arrival_spec &spec, int thread_index, int thread_count)
+        : spec_(spec), index_(thread_index), stride_(thread_count), rng_(spec.seed + thread_index),
+          gap_(double(thread_count) / spec.rate) {
+        next_ns_ = spec.kind == arrival_constant ? double(thread_index) * 1e9 / spec.rate : 0;
+    }
+
+    // Intended send time of the next record, in ns after the start of the run
+    uint64_t next() {
+        switch (spec_.kind) {
+        case arrival_constant: {
+            uint64_t t = uint64_t(next_ns_);
+            next_ns_ += gap_ * 1e9;
+            return t;
+        }
+        case arrival_poisson:
+            next_ns_ += std::exponential_distribution<double>(1.0 / gap_)(rng_) * 1e9;
+            return uint64_t(next_ns_);
+        case arrival_trace: {
+            // Replays the trace cyclically; one period is the trace span plus its mean gap
+            const std::vector<uint64_t> &trace = spec_.trace_ns;
+            uint64_t period = trace.back() + std::max<uint64_t>(trace.back() / trace.size(), 1);
+            uint64_t i = uint64_t(index_) + count_++ * uint64_t(stride_);
+            return (i / trace.size()) * period + trace[i % trace.size()];
+        }
+        default:
+            return 0;
+        }
+    }
+
+private:
+    const arrival_spec &spec_;
+    int index_;
+    int stride_;
+    std::mt19937_64 rng_;
+    double gap_;       // seconds between this producer's arrivals
+    double next_ns_;
+    uint64_t count_ = 0;
+};
+
+// Sleeps, then yields, until latency_now() reaches target
+inline void wait_until_ticks(uint64_t target) {
+    for (;;) {
+        uint64_t now = latency_now();
+        if (now >= target)
+            return;
+        double remaining_ns = double(target - now) * latency_ns_per_tick;
+        if (remaining_ns > 200000)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(uint64_t(remaining_ns) - 100000));
+        else
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_driver.h"
+
+// Grid for --sweep: every async backend runs once per combination
+struct sweep_spec {
+    bool enabled = false;
+    std::vector<int> queue_sizes = {1024, 16384, 131072, 1048576};
+    std::vector<int> workers = {1, 2};
+    std::vector<int> producers = {1, 4, 16};
+    std::vector<overflow_policy> policies = {overflow_block, overflow_drop};
+};
+
+std::vector<int> parse_int_list(const std::string &list) {
+    std::vector<int> values;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        values.push_back(atoi(list.c_str() + pos));
+        pos = list.find(',', pos);
+        if (pos == std::string::npos)
+            break;
+        pos++;
+    }
+    return values;
+}
+
+overflow_policy parse_overflow_policy(const std::string &name) {
+    if (name == "block")
+        return overflow_block;
+    if (name == "drop")
+        return overflow_drop;
+    if (name == "default")
+        return overflow_default;
+    throw std::runtime_error("Unknown overflow policy: " + name);
+}
+
+const char *overflow_policy_name(overflow_policy policy) {
+    switch (policy) {
+    case overflow_block: return "block";
+    case overflow_drop: return "drop";
+    default: return "default";
+    }
+}
+
+// Applies a --sweep* option; false if arg is not one
+bool parse_sweep_option(const std::string &arg, sweep_spec &spec) {
+    if (arg == "--sweep")
+        spec.enabled = true;
+    else if (arg.rfind("--sweep-queues=", 0) == 0)
+        spec.queue_sizes = parse_int_list(arg.substr(15));
+    else if (arg.rfind("--sweep-workers=", 0) == 0)
+        spec.workers = parse_int_list(arg.substr(16));
+    else if (arg.rfind("--sweep-producers=", 0) == 0)
+        spec.producers = parse_int_list(arg.substr(18));
+    else if (arg.rfind("--sweep-policies=", 0) == 0) {
+        spec.policies.clear();
+        std::string list = arg.substr(17);
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t comma = list.find(',', pos);
+            if (comma == std::string::npos)
+                comma = list.size();
+            spec.policies.push_back(parse_overflow_policy(list.substr(pos, comma - pos)));
+            pos = comma + 1;
+        }
+    }
+    else
+        return false;
+    return true;
+}
+
+// Runs the async backends across the sweep grid and prints one row per point.
+// Boost.Log and the ring buffer have a single feeding thread, so they run once per
+// point with "-" for workers. records/sec is over the producers' elapsed time, as in
+// the main report. The queue column is the capacity the backend actually used, which
+// for Boost.Log is the requested size rounded up to one of its compiled-in capacities.
+void run_async_sweep(const sweep_spec &sweep, const std::vector<std::string> &names, bench_config config) {
+    std::vector<const backend_entry *> backends;
+    for (auto *entry : select_backends(names))
+        if (entry->create()->is_async())
+            backends.push_back(entry);
+
+    std::cout << std::left << std::setw(14) << "backend" << std::right << std::setw(9) << "queue" << std::setw(8) << "workers"
+              << std::setw(10) << "producers" << std::setw(8) << "policy" << std::setw(14) << "records/sec"
+              << std::setw(12) << "stall ms" << std::setw(10) << "dropped" << std::setw(10) << "RSS MB"
+              << std::setw(12) << "p99 ns" << std::setw(14) << "max ns" << std::endl;
+
+    for (auto *entry : backends) {
+        bool uses_workers = entry->create()->uses_async_workers();
+        std::vector<int> worker_counts = uses_workers ? sweep.workers : std::vector<int>{1};
+        for (int queue_size : sweep.queue_sizes)
+            for (int workers : worker_counts)
+                for (int producers : sweep.producers)
+                    for (overflow_policy policy : sweep.policies) {
+                        config.queue_size = queue_size;
+                        config.async_workers = workers;
+                        config.thread_count = producers;
+                        config.overflow = policy;
+
+                        auto backend = entry->create();
+                        bench_result r = run_backend(*backend, config);
+                        auto ns = [](uint64_t ticks) { return uint64_t(double(ticks) * latency_ns_per_tick); };
+                        int64_t capacity = backend->queue_capacity();
+                        std::string queue = capacity < 0 ? std::to_string(queue_size) : capacity == 0 ? "unbounded" : std::to_string(capacity);
+
+                        std::cout << std::left << std::setw(14) << r.name << std::right << std::setw(9) << queue << std::setw(8)
+                                  << (uses_workers ? std::to_string(workers) : "-") << std::setw(10) << producers << std::setw(8)
+                                  << overflow_policy_name(policy) << std::setw(14) << uint64_t(r.records / r.elapsed_secs)
+                                  << std::setw(12) << std::fixed << std::setprecision(1) << r.stall_secs * 1000
+                                  << std::setw(10) << r.dropped << std::setw(10) << r.peak_rss_kb / 1024
+                                  << std::setw(12) << ns(r.latency.percentile(0.99)) << std::setw(14) << ns(r.latency.max())
+                                  << std::defaultfloat << std::endl;
+                    }
+    }
+}
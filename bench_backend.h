@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "affinity.h"
+#include "arrival.h"
+#include "output_sink.h"
+#include "workload.h"
+
+// What an async backend does when its queue is full. overflow_default keeps each
+// library's stock behaviour (spdlog blocks, Boost.Log uses an unbounded queue).
+enum overflow_policy { overflow_default, overflow_block, overflow_drop };
+
+// Settings shared by every backend for one benchmark run
+struct bench_config {
+    int howmany = 1000000;
+    int thread_count = 10;
+    int queue_size = 1000000 + 2;
+    // Consumer threads behind the async queue
+    int async_workers = 1;
+    overflow_policy overflow = overflow_default;
+    std::string log_dir = "logs";
+    // Pre-generated record stream shared by every backend
+    const workload *work = nullptr;
+    // Send schedule; null or arrival_closed means log as fast as possible
+    const arrival_spec *arrival = nullptr;
+    // Stamp every message and measure how long it takes to show up in the output file
+    bool end_to_end = false;
+    // Count cycles, cache misses and context switches per thread (perf_counters.h)
+    bool cpu_counters = false;
+    // Pin producers and the threads the backend starts in setup() (affinity.h)
+    affinity_mode affinity = affinity_none;
+    // Library file output, or a shared output_sink in its place (output_sink.h)
+    sink_kind sink = sink_native;
+    // Stress mode (rotation.h): rotate the library's file every rotate_bytes (0 = one
+    // static file) and give each logger fanout sinks, the extra ones socket_output_sinks
+    int64_t rotate_bytes = 0;
+    int fanout = 1;
+};
+
+// The configured output_sink for a backend that would write `path`, null for sink_native.
+// The mmap sink preallocates room for every record at its largest size.
+std::unique_ptr<output_sink> make_backend_sink(const bench_config &config, const std::string &path) {
+    return make_output_sink(config.sink, path, size_t(config.howmany) * size_t(config.work->spec().max_size + 128));
+}
+
+// A logging library (and mode) under test. The driver calls setup() once, then
+// log_one() from every producer thread, then flush() and teardown() once.
+class logger_backend {
+public:
+    virtual ~logger_backend() {}
+
+    // Short identifier used on the command line, e.g. "spdlog_async"
+    virtual const char *name() const = 0;
+    // Heading printed above the results, e.g. "Spdlog: Async Log"
+    virtual const char *title() const = 0;
+    // Exact bytes written by the backend's counting sink during the last run, or -1 if it
+    // has none and the driver should stat() the log directory instead
+    virtual int64_t bytes_written() const { return -1; }
+    // Records that reached the output during the last run, or -1 if unknown
+    virtual int64_t records_written() const { return -1; }
+    // File the records end up in, valid after setup(); empty if there is no single file
+    virtual std::string output_path() const { return ""; }
+    // Async backends take part in the queue saturation sweep
+    virtual bool is_async() const { return false; }
+    // Runs config.async_workers consumer threads; async backends with a single feeding
+    // thread ignore it, and the sweep runs them once per queue/producer/policy point
+    virtual bool uses_async_workers() const { return false; }
+    // Records the async queue actually holds after setup(), 0 if it is unbounded, or -1
+    // if it is exactly config.queue_size
+    virtual int64_t queue_capacity() const { return -1; }
+    // Can rotate its file by size and fan out to several sinks (--rotate / --fanout)
+    virtual bool supports_rotation() const { return false; }
+
+    virtual void setup(const bench_config &config) = 0;
+    // Called on each producer thread before its first and after its last record; thread_begin()
+    // runs before the start barrier, outside the measured interval
+    virtual void thread_begin() {}
+    virtual void thread_end() {}
+    // Logs one record; records below log_threshold must be filtered by the library itself
+    virtual void log_one(const log_record &rec) = 0;
+    virtual void flush() = 0;
+    virtual void teardown() = 0;
+};
+
+typedef std::function<std::unique_ptr<logger_backend>()> backend_factory;
+
+struct backend_entry {
+    std::string name;
+    backend_factory create;
+};
+
+// All backends linked into the binary, in registration (include) order
+std::vector<backend_entry> &backend_registry() {
+    static std::vector<backend_entry> registry;
+    return registry;
+}
+
+const backend_entry *find_backend(const std::string &name) {
+    for (auto &entry : backend_registry())
+        if (entry.name == name)
+            return &entry;
+    return nullptr;
+}
+
+template <typename Backend>
+struct backend_registrar {
+    backend_registrar() {
+        backend_registry().push_back({Backend().name(), [] { return std::unique_ptr<logger_backend>(new Backend()); }});
+    }
+};
+
+// Self-registers a logger_backend subclass from the header that defines it
+#define REGISTER_LOGGER_BACKEND(type) static backend_registrar<type> type##_registrar;
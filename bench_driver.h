@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alloc_accounting.h"
+#include "bench_backend.h"
+#include "end_to_end.h"
+#include "io_accounting.h"
+#include "latency_histogram.h"
+#include "perf_counters.h"
+#include "resource_usage.h"
+#include "rotation.h"
+
+// Holds every producer until all of them are running, so thread creation
+// is not part of the measured interval.
+class start_barrier {
+public:
+    explicit start_barrier(int count) : waiting_(count) {}
+
+    // Returns the latency_now() timestamp taken at release
+    uint64_t arrive_and_wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (--waiting_ == 0)
+            all_arrived_.notify_one();
+        go_.wait(lock, [this] { return released_; });
+        return start_ticks_;
+    }
+
+    // Blocks the caller until every producer is parked in arrive_and_wait()
+    void wait_for_arrivals() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        all_arrived_.wait(lock, [this] { return waiting_ == 0; });
+    }
+
+    // Returns the same timestamp as arrive_and_wait()
+    uint64_t release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        start_ticks_ = latency_now();
+        released_ = true;
+        go_.notify_all();
+        return start_ticks_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable all_arrived_;
+    std::condition_variable go_;
+    int waiting_;
+    bool released_ = false;
+    uint64_t start_ticks_ = 0;
+};
+
+// Log calls slower than this count as producer stall time
+double stall_threshold_us = 10;
+
+// --rotate / --fanout: only backends that support it run, and slow calls are kept
+bool rotation_stress(const bench_config &config) { return config.rotate_bytes > 0 || config.fanout > 1; }
+
+struct bench_result {
+    std::string name;
+    int records = 0;
+    uint64_t enabled_records = 0;
+    uint64_t payload_bytes = 0;
+    int threads = 0;
+    // Latency measured from intended send times (open-loop) rather than per call
+    bool open_loop = false;
+    double elapsed_secs = 0;
+    // flush() plus teardown(), i.e. until the last record has been handed to the OS
+    double drain_secs = 0;
+    latency_histogram latency;
+
+    uint64_t bytes_written = 0;
+    const char *bytes_source = "";
+    bool has_syscalls = false;
+    uint64_t write_calls = 0;
+    uint64_t fsync_calls = 0;
+
+    // Enabled records that never reached the output, -1 if the backend cannot tell
+    int64_t dropped = -1;
+    // Estimated time all producers together spent in calls slower than stall_threshold_us
+    double stall_secs = 0;
+    long peak_rss_kb = 0;
+    // False if the peak covers the whole process lifetime rather than just this run
+    bool peak_rss_isolated = false;
+
+    // Send-to-visible-in-file figures, end-to-end mode only
+    bool has_e2e = false;
+    e2e_stats e2e;
+
+    // --perf only: each producer over its own records, and the whole process including drain
+    bool has_cpu = false;
+    std::vector<cpu_counters> thread_cpu;
+    std::vector<int> thread_records;
+    cpu_counters total_cpu;
+
+    // --alloc only: heap use of the producers' log calls, and of the whole run after setup
+    bool has_alloc = false;
+    alloc_snapshot hot_alloc;
+    alloc_snapshot run_alloc;
+    // Above the live heap before setup, so it includes queues the backend preallocates
+    int64_t peak_heap_bytes = 0;
+
+    // CPUs the producers and backend threads were pinned to, empty if unpinned
+    thread_placement placement;
+
+    // --rotate / --fanout only: rotations during the run and the slow calls around them
+    bool has_rotation = false;
+    rotation_report rotation;
+    int64_t rotate_bytes = 0;
+    int fanout = 1;
+};
+
+// What one producer measured about itself
+struct thread_stats {
+    cpu_counters cpu;
+    alloc_snapshot alloc;
+    std::vector<latency_spike> spikes;
+};
+
+void bench_thread_fun(logger_backend &backend, const bench_config &config, start_barrier &barrier, int thread_index,
+                      const log_record *records, int howmany, shared_latency_histogram *latency, thread_stats *stats, int cpu) {
+    if (cpu >= 0)
+        pin_thread(0, cpu);
+    thread_counters counters;
+    if (config.cpu_counters)
+        counters.open();
+    backend.thread_begin();
+    uint64_t start_ticks = barrier.arrive_and_wait();
+
+    if (config.cpu_counters)
+        counters.start();
+    latency_recorder recorder;
+    if (rotation_stress(config))
+        recorder.capture_spikes(uint64_t(stall_threshold_us * 1000 / latency_ns_per_tick), rotation_max_spikes);
+    e2e_stamper stamper(thread_index, config.work->spec().max_size);
+    auto log_one = [&](const log_record &rec) { backend.log_one(config.end_to_end ? stamper.stamp(rec) : rec); };
+    alloc_snapshot alloc_before = thread_alloc_snapshot();
+
+    if (!config.arrival || config.arrival->kind == arrival_closed) {
+        for (int i = 0; i < howmany; i++)
+            recorder.measure([&] { log_one(records[i]); });
+    }
+    else {
+        arrival_generator arrivals(*config.arrival, thread_index, config.thread_count);
+        for (int i = 0; i < howmany; i++) {
+            uint64_t intended = start_ticks + uint64_t(double(arrivals.next()) / latency_ns_per_tick);
+            wait_until_ticks(intended);
+            recorder.measure_since(intended, [&] { log_one(records[i]); });
+        }
+    }
+    alloc_snapshot alloc_after = thread_alloc_snapshot();
+    backend.thread_end();
+    if (config.cpu_counters)
+        stats->cpu = counters.stop();
+    stats->alloc.allocations = alloc_after.allocations - alloc_before.allocations;
+    stats->alloc.frees = alloc_after.frees - alloc_before.frees;
+    stats->alloc.bytes = alloc_after.bytes - alloc_before.bytes;
+    flush_thread_alloc_counts();
+    stats->spikes = recorder.spikes();
+
+    recorder.publish(latency);
+}
+
+bench_result run_backend(logger_backend &backend, const bench_config &config) {
+    using std::chrono::high_resolution_clock;
+
+    if (rotation_stress(config) && !backend.supports_rotation())
+        throw std::runtime_error(std::string(backend.name()) + " does not support --rotate / --fanout");
+
+    if (config.rotate_bytes > 0 && config.sink != sink_native)
+        throw std::runtime_error("--rotate rotates the libraries' own files and needs --sink=native");
+
+    bool rss_reset = reset_peak_rss();
+    rotation_log.reset();
+    int64_t heap_before = reset_peak_live_heap();
+    std::vector<int> ids_before = thread_ids();
+    backend.setup(config);
+
+    // Threads that appeared during setup() are the backend's workers
+    std::vector<int> worker_ids;
+    for (int id : thread_ids())
+        if (!std::binary_search(ids_before.begin(), ids_before.end(), id))
+            worker_ids.push_back(id);
+    thread_placement placement = place_threads(config.affinity, config.thread_count, int(worker_ids.size()));
+    for (size_t i = 0; i < placement.workers.size(); i++)
+        pin_thread(worker_ids[i], placement.workers[i]);
+    alloc_snapshot alloc_before = process_alloc_snapshot();
+    dir_usage files_before(config.log_dir);
+    io_snapshot io_before = take_io_snapshot();
+
+    std::unique_ptr<e2e_reader> reader;
+    if (config.end_to_end) {
+        if (backend.output_path().empty())
+            throw std::runtime_error(std::string(backend.name()) + " has no output file for end-to-end mode");
+        if (config.sink == sink_mmap)
+            throw std::runtime_error("End-to-end mode cannot tail the preallocated mmap sink file");
+        if (config.rotate_bytes > 0)
+            throw std::runtime_error("End-to-end mode cannot follow a rotating log file");
+        reader.reset(new e2e_reader(backend.output_path(), config.thread_count));
+    }
+
+    std::vector<std::thread> threads;
+    shared_latency_histogram latency;
+    start_barrier barrier(config.thread_count);
+    process_counters process_cpu;
+    std::vector<thread_stats> stats(size_t(config.thread_count));
+    std::vector<int> thread_records;
+    if (config.cpu_counters)
+        process_cpu.start();
+
+    // Every thread logs its own contiguous slice of the shared record stream
+    const log_record *records = config.work->records();
+    int msgs_per_thread = config.howmany / config.thread_count;
+    int msgs_per_thread_mod = config.howmany % config.thread_count;
+    for (int t = 0; t < config.thread_count; ++t) {
+        int howmany = (t == 0) ? msgs_per_thread + msgs_per_thread_mod : msgs_per_thread;
+        threads.push_back(std::thread(bench_thread_fun, std::ref(backend), std::cref(config), std::ref(barrier), t, records, howmany, &latency, &stats[t],
+                                      placement.producers.empty() ? -1 : placement.producers[t]));
+        thread_records.push_back(howmany);
+        records += howmany;
+    }
+
+    barrier.wait_for_arrivals();
+    auto start = high_resolution_clock::now();
+    uint64_t start_ticks = barrier.release();
+    for (auto &t : threads)
+        t.join();
+    auto produced = high_resolution_clock::now();
+
+    backend.flush();
+    backend.teardown();
+    auto drained = high_resolution_clock::now();
+    io_snapshot io_after = take_io_snapshot();
+    alloc_snapshot alloc_after = process_alloc_snapshot();
+    std::vector<cpu_counters> thread_cpu;
+    for (auto &s : stats)
+        thread_cpu.push_back(s.cpu);
+    cpu_counters total_cpu;
+    if (config.cpu_counters)
+        total_cpu = process_cpu.stop(thread_cpu);
+
+    bench_result result;
+    if (reader) {
+        result.has_e2e = true;
+        result.e2e = reader->finish();
+    }
+    result.name = backend.name();
+    result.records = config.howmany;
+    result.enabled_records = config.work->enabled(config.howmany);
+    result.payload_bytes = config.work->payload_bytes(config.howmany);
+    result.threads = config.thread_count;
+    result.open_loop = config.arrival && config.arrival->kind != arrival_closed;
+    result.elapsed_secs = std::chrono::duration<double>(produced - start).count();
+    result.drain_secs = std::chrono::duration<double>(drained - produced).count();
+    result.latency = latency.snapshot();
+
+    int64_t sink_bytes = backend.bytes_written();
+    if (sink_bytes >= 0) {
+        result.bytes_written = uint64_t(sink_bytes);
+        result.bytes_source = "sink";
+    }
+    else {
+        result.bytes_written = dir_usage(config.log_dir).bytes_since(files_before);
+        result.bytes_source = "stat";
+    }
+    result.has_syscalls = io_after.has_proc;
+    result.write_calls = io_after.write_calls - io_before.write_calls;
+    result.fsync_calls = io_after.fsync_calls - io_before.fsync_calls;
+
+    int64_t written = backend.records_written();
+    if (written >= 0)
+        result.dropped = int64_t(result.enabled_records) - written;
+    uint64_t stall_ticks = uint64_t(stall_threshold_us * 1000 / latency_ns_per_tick);
+    result.stall_secs = result.latency.sum_above(stall_ticks) * latency_ns_per_tick / 1e9 * std::max(latency_sample_every, 1);
+    result.peak_rss_kb = peak_rss_kb();
+    result.peak_rss_isolated = rss_reset;
+    result.placement = placement;
+
+    if (config.cpu_counters) {
+        result.has_cpu = true;
+        result.total_cpu = total_cpu;
+        result.thread_cpu = thread_cpu;
+        result.thread_records = thread_records;
+    }
+    if (alloc_counting) {
+        result.has_alloc = true;
+        for (auto &s : stats) {
+            result.hot_alloc.allocations += s.alloc.allocations;
+            result.hot_alloc.frees += s.alloc.frees;
+            result.hot_alloc.bytes += s.alloc.bytes;
+        }
+        result.run_alloc.allocations = alloc_after.allocations - alloc_before.allocations;
+        result.run_alloc.frees = alloc_after.frees - alloc_before.frees;
+        result.run_alloc.bytes = alloc_after.bytes - alloc_before.bytes;
+        result.peak_heap_bytes = peak_live_heap() - heap_before;
+    }
+    if (rotation_stress(config)) {
+        std::vector<latency_spike> spikes;
+        for (auto &s : stats)
+            spikes.insert(spikes.end(), s.spikes.begin(), s.spikes.end());
+        result.has_rotation = true;
+        result.rotation = correlate_rotations(rotation_log.ticks(), spikes, start_ticks);
+        result.rotate_bytes = config.rotate_bytes;
+        result.fanout = config.fanout;
+    }
+    return result;
+}
+
+void print_bench_result(const bench_result &result) {
+    double delta_d = result.elapsed_secs;
+    double written_d = result.elapsed_secs + result.drain_secs;
+    std::cout << "Elapsed: " << delta_d << "secs\t" << double(result.bytes_written) / written_d / 1024 / 1024 << " MB/sec"
+              << "\t(drain " << result.drain_secs << "secs)" << std::endl;
+    std::cout << "Throughput: " << uint64_t(result.records / delta_d) << " records/sec\t"
+              << uint64_t(result.enabled_records / delta_d) << " written records/sec\t"
+              << double(result.payload_bytes) / delta_d / 1024 / 1024 << " payload MB/sec" << std::endl;
+    std::cout << "I/O: " << result.bytes_written << " bytes (" << result.bytes_source << ")";
+    if (result.has_syscalls)
+        std::cout << "\t" << result.write_calls << " write() calls, "
+                  << (result.write_calls ? result.bytes_written / result.write_calls : 0) << " bytes/call";
+    std::cout << "\t" << result.fsync_calls << " fsync() calls" << std::endl;
+    std::cout << "Stall: " << result.stall_secs << "secs in calls > " << stall_threshold_us << "us\tDropped: ";
+    if (result.dropped >= 0)
+        std::cout << result.dropped;
+    else
+        std::cout << "n/a";
+    std::cout << "\tPeak RSS: " << result.peak_rss_kb / 1024 << " MB" << (result.peak_rss_isolated ? "" : " (process)") << std::endl;
+    if (!result.placement.producers.empty()) {
+        auto cpu_list = [](const std::vector<int> &cpus) {
+            std::string list;
+            for (int cpu : cpus)
+                list += (list.empty() ? "" : ",") + std::to_string(cpu);
+            return list.empty() ? std::string("-") : list;
+        };
+        std::cout << "Pinning: producers on CPUs " << cpu_list(result.placement.producers) << "\tbackend threads on CPUs "
+                  << cpu_list(result.placement.workers) << std::endl;
+    }
+    print_latency_report(result.open_loop ? result.name + " from intended send" : result.name, result.latency);
+    if (result.has_e2e) {
+        print_latency_report(result.name + " end-to-end", result.e2e.latency);
+        std::cout << "Ordering: " << result.e2e.lines << " stamped lines read, " << result.e2e.seq_violations
+                  << " per-producer sequence violations, " << result.e2e.send_order_violations << " lines out of send order" << std::endl;
+    }
+    if (result.has_cpu) {
+        for (size_t t = 0; t < result.thread_cpu.size(); t++)
+            print_cpu_counters(result.name + " thread " + std::to_string(t), result.thread_cpu[t], uint64_t(result.thread_records[t]));
+        print_cpu_counters(result.name + " all threads", result.total_cpu, uint64_t(result.records));
+    }
+    if (result.has_alloc) {
+        double per = result.records ? 1.0 / result.records : 0;
+        std::cout << "Allocations: " << double(result.hot_alloc.allocations) * per << "/record, "
+                  << double(result.hot_alloc.bytes) * per << " bytes/record in log calls\t"
+                  << double(result.run_alloc.allocations) * per << "/record, " << double(result.run_alloc.bytes) * per
+                  << " bytes/record whole run\tPeak live heap: " << double(result.peak_heap_bytes) / 1024 / 1024 << " MB" << std::endl;
+    }
+    if (result.has_rotation)
+        print_rotation_report(result.rotation, result.rotate_bytes, result.fanout, stall_threshold_us);
+    std::cout << std::endl;
+}
+
+// Registry entries for the named backends; an empty list selects all of them
+std::vector<const backend_entry *> select_backends(const std::vector<std::string> &names) {
+    std::vector<const backend_entry *> selected;
+    if (names.empty())
+        for (auto &entry : backend_registry())
+            selected.push_back(&entry);
+    for (auto &name : names) {
+        const backend_entry *entry = find_backend(name);
+        if (!entry)
+            throw std::runtime_error("Unknown backend: " + name);
+        selected.push_back(entry);
+    }
+    return selected;
+}
+
+// Runs the named backends one after another
+void run_backends(const std::vector<std::string> &names, const bench_config &config) {
+    for (auto *entry : select_backends(names)) {
+        auto backend = entry->create();
+        if (rotation_stress(config) && !backend->supports_rotation()) {
+            std::cout << backend->name() << ": skipped, no rotation / fan-out support" << std::endl << std::endl;
+            continue;
+        }
+        std::cout << "*********************************" << std::endl;
+        std::cout << backend->title() << std::endl;
+        std::cout << "*********************************" << std::endl;
+
+        bench_result result = run_backend(*backend, config);
+        print_bench_result(result);
+    }
+}
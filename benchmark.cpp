@@ -1,68 +1,205 @@
 #include "spdlog_bench.h"
 #include "glog_bench.h"
 #include "boost_bench.h"
+#include "ring_bench.h"
+#include "bench_driver.h"
+#include "async_sweep.h"
+#include "rate_search.h"
+#include "scaling.h"
+#include "runner.h"
+#include "microbench.h"
+#include "latency_histogram.h"
+
+#include <sys/stat.h>
 
 #include <atomic>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <thread>
 
 using namespace std;
 using namespace std::chrono;
 
+// Splits "a,b,c" into {"a", "b", "c"}
+std::vector<std::string> split_list(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+void print_usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [messages] [threads] [queue_size] [sample_every] [steady|rdtsc] [options]" << std::endl;
+    std::cout << "  --backends=a,b,...  run only the listed backends (default: all)" << std::endl;
+    std::cout << "  --log-dir=DIR       directory for the log files (default: logs)" << std::endl;
+    std::cout << "  --e2e               stamp each record and measure send-to-file latency and ordering" << std::endl;
+    std::cout << "  --perf              per-thread CPU counters: IPC, LLC misses and context switches per record" << std::endl;
+    std::cout << "  --alloc             count heap allocations and bytes per record and the peak live heap" << std::endl;
+    std::cout << "  --workers=N         consumer threads of the async backends (default: 1)" << std::endl;
+    std::cout << "  --sink=KIND         native (each library's own file, default), null, buffered," << std::endl;
+    std::cout << "                      mmap (preallocated file) or direct (O_DIRECT, fdatasync per 1 MB)" << std::endl;
+    std::cout << "  --pin=MODE          pin producers and backend threads: none (default), compact, spread" << std::endl;
+    std::cout << "                      or cross-socket (producers on the first NUMA node, workers on the last)" << std::endl;
+    std::cout << "  --scaling           run each backend at 1, 2, 4, ... producers up to --max-threads=N" << std::endl;
+    std::cout << "                      (default: all CPUs) and print throughput, p99 and efficiency" << std::endl;
+    std::cout << "  --rotate=SIZE       stress mode: rotate the log file every SIZE bytes (e.g. 64K, 1M; glog" << std::endl;
+    std::cout << "                      rounds up to whole MB) and report slow calls around each rotation;" << std::endl;
+    std::cout << "                      glog opens at most one file per second and drops records until then" << std::endl;
+    std::cout << "  --fanout=N          stress mode: 1-4 sinks per logger, the extra ones unbuffered socket sinks" << std::endl;
+    std::cout << "  --overflow=POLICY   async queue overflow: default, block or drop" << std::endl;
+    std::cout << "                      (drop = spdlog overrun_oldest / Boost drop_on_overflow)" << std::endl;
+    std::cout << "  --sweep             run the async backends over a queue/worker/producer/policy grid" << std::endl;
+    std::cout << "  --sweep-queues=a,b  --sweep-workers=a,b  --sweep-producers=a,b  --sweep-policies=block,drop" << std::endl;
+    std::cout << "                      Boost bounded queues round up to 1024, 16384, 131072 or 1048576" << std::endl;
+    std::cout << "  --arrival=KIND      closed (default), constant, poisson or trace:FILE" << std::endl;
+    std::cout << "                      (trace lines are \"<time_us> [count]\"); open-loop latency is" << std::endl;
+    std::cout << "                      measured from each record's intended send time" << std::endl;
+    std::cout << "  --rate=N            total open-loop records/sec across producers (default: 100000)" << std::endl;
+    std::cout << "  --find-max-rate     search the highest open-loop rate with p99 under --p99-limit-us" << std::endl;
+    std::cout << "  --p99-limit-us=N --start-rate=N --step-secs=S" << std::endl;
+    std::cout << "                      search limits (default: 1000us, 10000/sec, 1s per step)" << std::endl;
+    std::cout << "  --ints=N --floats=N --strings=N" << std::endl;
+    std::cout << "                      arguments per record, at most 8 in total (default: 0)" << std::endl;
+    std::cout << "  --msg-size=N|A-B    message text length, fixed or uniform in [A, B] (default: 26)" << std::endl;
+    std::cout << "  --levels=D,I,W,E    weights of debug/info/warn/error records; debug is filtered (default: 0,1,0,0)" << std::endl;
+    std::cout << "  --seed=N            workload random seed (default: 42)" << std::endl;
+    std::cout << "  --repeat=N          run each backend N times, each in a fresh child process, and" << std::endl;
+    std::cout << "                      print mean, stddev and 95% CI (after --warmup=N runs, default: 1)" << std::endl;
+    std::cout << "  --between=MODE      before every repeated run: none (default), sync or drop-caches" << std::endl;
+    std::cout << "  --json=FILE --csv=FILE" << std::endl;
+    std::cout << "                      also write the repeated-run statistics as JSON / CSV" << std::endl;
+    std::cout << "  --micro             ns/call of enabled, runtime-disabled and compile-time-removed log" << std::endl;
+    std::cout << "                      statements per library, and of fmt / ostream / boost::format alone" << std::endl;
+    std::cout << "  --micro-iters=N     calls per trial (default: 10000000, median of 5 trials)" << std::endl;
+    std::cout << "  --list              print the registered backends and exit" << std::endl;
+}
+
 int main(int argc, char *argv[]) {
-    int howmany = 1000000;
-    int thread_count = 10;
-    int queue_size = howmany + 2;
+    bench_config config;
+    workload_spec spec;
+    sweep_spec sweep;
+    arrival_spec arrival;
+    rate_search_spec rate_search;
+    scaling_spec scaling;
+    repeat_spec repeat;
+    micro_spec micro;
+    // Everything but the runner's own options, passed on to the --repeat children
+    std::vector<std::string> child_args;
+    std::vector<std::string> backends;
+    std::vector<std::string> positional;
 
     try {
-        if (argc > 1) howmany = atoi(argv[1]);
-        if (argc > 2) thread_count = atoi(argv[2]);
-        if (argc > 3) {
-            queue_size = atoi(argv[3]);
-            if (queue_size > 500000) {
-                std::cout << "Max queue size allowed: 500,000" << std::endl;
-                exit(1);
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (parse_repeat_option(arg, repeat))
+                continue;
+            if (arg.rfind("--backends=", 0) != 0)
+                child_args.push_back(arg);
+
+            if (arg.rfind("--backends=", 0) == 0)
+                backends = split_list(arg.substr(11));
+            else if (arg.rfind("--log-dir=", 0) == 0)
+                config.log_dir = arg.substr(10);
+            else if (arg == "--e2e")
+                config.end_to_end = true;
+            else if (arg == "--perf")
+                config.cpu_counters = true;
+            else if (arg == "--alloc")
+                alloc_counting = true;
+            else if (arg.rfind("--workers=", 0) == 0)
+                config.async_workers = atoi(arg.c_str() + 10);
+            else if (arg.rfind("--overflow=", 0) == 0)
+                config.overflow = parse_overflow_policy(arg.substr(11));
+            else if (arg.rfind("--sink=", 0) == 0)
+                config.sink = parse_sink_kind(arg.substr(7));
+            else if (arg.rfind("--rotate=", 0) == 0)
+                config.rotate_bytes = parse_byte_size(arg.substr(9));
+            else if (arg.rfind("--fanout=", 0) == 0) {
+                config.fanout = atoi(arg.c_str() + 9);
+                if (config.fanout < 1 || config.fanout > 4)
+                    throw std::runtime_error("--fanout takes 1 to 4 sinks");
+            }
+            else if (arg.rfind("--pin=", 0) == 0)
+                config.affinity = parse_affinity_mode(arg.substr(6));
+            else if (parse_workload_option(arg, spec) || parse_sweep_option(arg, sweep) || parse_arrival_option(arg, arrival) ||
+                     parse_rate_search_option(arg, rate_search) || parse_scaling_option(arg, scaling) ||
+                     parse_micro_option(arg, micro))
+                continue;
+            else if (arg == "--list") {
+                for (auto &entry : backend_registry())
+                    std::cout << entry.name << std::endl;
+                return 0;
+            }
+            else if (arg == "--help" || arg == "-h") {
+                print_usage(argv[0]);
+                return 0;
+            }
+            else if (arg.rfind("--", 0) == 0) {
+                print_usage(argv[0]);
+                return 1;
             }
+            else
+                positional.push_back(arg);
         }
 
-        auto slot_size = sizeof(spdlog::details::async_msg);
-        std::cout << "-------------------------------------------------" << std::endl;
-        std::cout << "Messages     : " << howmany << std::endl;
-        std::cout << "Threads      : " << thread_count << std::endl;
-        std::cout << "Queue        : " << queue_size << " slots" << std::endl;
-        std::cout << "Queue memory : " << queue_size << " x " << slot_size << " = " << (queue_size * slot_size) / 1024 / 1024 << " MB " << std::endl;
-        std::cout << "-------------------------------------------------" << std::endl;
-
-        std::cout << "*********************************" << std::endl;
-        std::cout << "Spdlog: Sync Log" << std::endl;
-        std::cout << "*********************************" << std::endl;
+        // The children only know plain runs, so the other modes would silently turn into one
+        if ((repeat.repetitions > 0 || repeat.report_fd >= 0) &&
+            (micro.enabled || sweep.enabled || scaling.enabled || rate_search.enabled))
+            throw std::runtime_error("--repeat cannot be combined with --micro, --sweep, --scaling or --find-max-rate");
 
-        spdlog_sync_bench(howmany, thread_count);
+        if (positional.size() > 0) config.howmany = atoi(positional[0].c_str());
+        if (positional.size() > 1) config.thread_count = atoi(positional[1].c_str());
+        if (positional.size() > 2) config.queue_size = atoi(positional[2].c_str());
+        if (positional.size() > 3) latency_sample_every = atoi(positional[3].c_str());
+        if (positional.size() > 4) latency_use_rdtsc = positional[4] == "rdtsc";
+        latency_clock_init();
+        mkdir(config.log_dir.c_str(), 0755);
 
-        std::cout << "*********************************" << std::endl;
-        std::cout << "Spdlog: Async Log" << std::endl;
-        std::cout << "*********************************" << std::endl;
+        workload work(spec, config.howmany);
+        config.work = &work;
+        config.arrival = &arrival;
 
-        spdlog_async_bench(howmany, thread_count, queue_size);
-
-        std::cout << "*********************************" << std::endl;
-        std::cout << "Glog: Sync Log" << std::endl;
-        std::cout << "*********************************" << std::endl;
-
-        glog_sync_bench(howmany, thread_count);
-
-        std::cout << "*********************************" << std::endl;
-        std::cout << "Boost Log: Sync Log" << std::endl;
-        std::cout << "*********************************" << std::endl;
-
-        boost_sync_bench(howmany, thread_count, queue_size);
-
-        std::cout << "*********************************" << std::endl;
-        std::cout << "Boost Log: Async Log" << std::endl;
-        std::cout << "*********************************" << std::endl;
+        auto slot_size = sizeof(spdlog::details::async_msg);
+        std::cout << "-------------------------------------------------" << std::endl;
+        std::cout << "Messages     : " << config.howmany << std::endl;
+        std::cout << "Threads      : " << config.thread_count << std::endl;
+        std::cout << "Queue        : " << config.queue_size << " slots" << std::endl;
+        std::cout << "Queue memory : " << config.queue_size << " x " << slot_size << " = " << (config.queue_size * slot_size) / 1024 / 1024 << " MB " << std::endl;
+        std::cout << "Workload     : " << spec.int_args << " int, " << spec.float_args << " float, " << spec.string_args << " string args, "
+                  << spec.min_size << "-" << spec.max_size << " chars, " << work.enabled() << " records above threshold" << std::endl;
+        std::cout << "Arrival      : " << arrival_kind_name(arrival.kind);
+        if (arrival.kind == arrival_constant || arrival.kind == arrival_poisson)
+            std::cout << " at " << arrival.rate << " records/sec";
+        else if (arrival.kind == arrival_trace)
+            std::cout << " " << arrival.trace_file << " (" << arrival.trace_ns.size() << " sends per period)";
+        std::cout << std::endl;
+        std::cout << "Sink         : " << sink_kind_name(config.sink);
+        if (config.rotate_bytes > 0)
+            std::cout << ", rotated every " << config.rotate_bytes << " bytes";
+        if (config.fanout > 1)
+            std::cout << ", " << config.fanout << " sinks per logger";
+        std::cout << std::endl;
+        std::cout << "Latency      : 1/" << latency_sample_every << " calls sampled with " << latency_clock_name() << std::endl;
+        std::cout << "-------------------------------------------------" << std::endl;
 
-        boost_async_bench(howmany, thread_count, queue_size);
+        if (repeat.report_fd >= 0)
+            run_reporting_child(backends, config, repeat.report_fd);
+        else if (repeat.repetitions > 0)
+            run_repeated(repeat, backends, config, self_executable(argv[0]), child_args);
+        else if (micro.enabled)
+            run_microbenchmarks(micro, work);
+        else if (sweep.enabled)
+            run_async_sweep(sweep, backends, config);
+        else if (scaling.enabled)
+            run_thread_scaling(scaling, backends, config);
+        else if (rate_search.enabled)
+            find_max_rates(rate_search, backends, config, arrival);
+        else
+            run_backends(backends, config);
     }
     catch (std::exception &ex) {
         std::cerr << "Error: " << ex.what() << std::endl;
@@ -71,4 +208,4 @@ int main(int argc, char *argv[]) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -24,20 +24,25 @@
 #include <string>
 #include <iostream>
 #include <fstream>
-#include <boost/core/ref.hpp>
-#include <boost/bind/bind.hpp>
+#include <atomic>
+#include <functional>
+#include <vector>
 #include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/smart_ptr/make_shared_object.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/thread/barrier.hpp>
 
 #include <boost/log/common.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/sinks.hpp>
 #include <boost/log/sources/logger.hpp>
+#include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/utility/record_ordering.hpp>
 
+#include "bench_backend.h"
+#include "rotation.h"
+
 namespace logging = boost::log;
 namespace attrs = boost::log::attributes;
 namespace src = boost::log::sources;
@@ -48,80 +53,155 @@ using namespace std::chrono;
 
 // #endif BOOST_BENCH_INCLUDE
 
-BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(test_lg, src::logger_mt)
+BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(test_lg, src::severity_logger_mt< log_level >)
 
-typedef void (*thread_fun_type)(boost::barrier&, int);
+// text_ostream_backend that also counts the records it has written out
+class counting_ostream_backend : public boost::log::sinks::text_ostream_backend {
+public:
+    void consume(logging::record_view const& rec, string_type const& formatted_message)
+    {
+        boost::log::sinks::text_ostream_backend::consume(rec, formatted_message);
+        records_.fetch_add(1, std::memory_order_relaxed);
+    }
 
-//! This function is executed in multiple threads
-void sync_thread_fun(boost::barrier& bar, int howmany)
-{
-    // Wait until all threads are created
-    bar.wait();
+    uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic< uint64_t > records_{0};
+};
 
-    // Now, do some logging
-    for (int i = 0; i < howmany; ++i)
+// text_file_backend, the rotating file sink, counting its records the same way
+class counting_file_backend : public boost::log::sinks::text_file_backend {
+public:
+    template< typename... ArgsT >
+    explicit counting_file_backend(ArgsT const&... args) : boost::log::sinks::text_file_backend(args...) {}
+
+    void consume(logging::record_view const& rec, string_type const& formatted_message)
     {
-        BOOST_LOG(test_lg::get()) << "Hello logger: msg number x";
-        // BOOST_LOG(test_lg::get()) << "Hello logger: msg number " << 1.23;
-        // BOOST_LOG(test_lg::get()) << "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789";
+        boost::log::sinks::text_file_backend::consume(rec, formatted_message);
+        records_.fetch_add(1, std::memory_order_relaxed);
     }
-}
 
-void async_thread_fun(boost::barrier& bar, int howmany)
+    uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic< uint64_t > records_{0};
+};
+
+// The file stream for sink_native, otherwise a stream into the configured output sink
+boost::shared_ptr< std::ostream > open_log_stream(const bench_config& config, const std::string& path)
 {
-    // Wait until all threads are created
-    bar.wait();
+    if (auto out = make_backend_sink(config, path))
+        return boost::make_shared< output_sink_ostream >(std::move(out));
 
-    // Here we go. First, identify the thread.
-    BOOST_LOG_SCOPED_THREAD_TAG("ThreadID", boost::this_thread::get_id());
+    boost::shared_ptr< std::ostream > strm = boost::make_shared< std::ofstream >(path);
+    if (!strm->good())
+        throw std::runtime_error("Failed to open a text log file");
+    return strm;
+}
+
+// Writes out and trims the file of an output_sink_ostream; ofstreams close on destruction
+void close_log_stream(const boost::shared_ptr< std::ostream >& strm)
+{
+    if (auto sink_strm = dynamic_cast< output_sink_ostream* >(strm.get()))
+        sink_strm->close();
+}
 
-    // Now, do some logging
-    for (int i = 0; i < howmany; ++i)
+class boost_sync_backend : public logger_backend {
+public:
+    const char *name() const override { return "boost_sync"; }
+    const char *title() const override { return "Boost Log: Sync Log"; }
+    // The stream position after the final flush is the number of bytes written; rotated
+    // files report their size as they are closed
+    int64_t bytes_written() const override
     {
-        BOOST_LOG(test_lg::get()) << "Hello logger: msg number x";
-        // BOOST_LOG(test_lg::get()) << "Hello logger: msg number " << 1.23;
-        // BOOST_LOG(test_lg::get()) << "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789";
+        if (file_backend_)
+            return int64_t(rotation_log.bytes());
+        return strm_ ? int64_t(strm_->tellp()) : -1;
     }
-}
+    std::string output_path() const override { return path_; }
+    int64_t records_written() const override
+    {
+        if (file_backend_)
+            return int64_t(file_backend_->records());
+        return backend_ ? int64_t(backend_->records()) : -1;
+    }
+    bool supports_rotation() const override { return true; }
 
-void boost_mt(int howmany, int thread_count, thread_fun_type thread_fun) {
-    using std::chrono::high_resolution_clock;
-    auto start = high_resolution_clock::now();
-
-    // Create logging threads
-    boost::barrier bar(thread_count);
-    boost::thread_group threads;
-    int msgs_per_thread = howmany / thread_count;
-    int msgs_per_thread_mod = howmany % thread_count;
-    for (int t = 0; t < thread_count; ++t)
-        if (t == 0 && msgs_per_thread_mod)
-            threads.create_thread(boost::bind(thread_fun, boost::ref(bar), msgs_per_thread + msgs_per_thread_mod));
-        else    
-            threads.create_thread(boost::bind(thread_fun, boost::ref(bar), msgs_per_thread));
-
-    // Wait until all action ends
-    threads.join_all();
-
-    auto delta = high_resolution_clock::now() - start;
-    auto delta_d = duration_cast<duration<double>>(delta).count();
-    std::cout << "Elapsed: " << delta_d << "secs\t" << int(howmany / delta_d) * (81+74) / 1024 /1024  << " MB/sec" << std::endl << std::endl;
-}
+    void setup(const bench_config &config) override
+    {
+        if (config.rotate_bytes > 0)
+        {
+            // Size-based rotation through text_file_backend, numbering the files
+            file_backend_ = boost::make_shared< counting_file_backend >(
+                keywords::file_name = config.log_dir + "/boost_sync_%N.txt",
+                keywords::rotation_size = config.rotate_bytes);
+            file_backend_->set_open_handler([](std::ostream&) { rotation_log.file_opened(); });
+            file_backend_->set_close_handler([](std::ostream& strm) { rotation_log.file_closed(uint64_t(strm.tellp())); });
+            path_ = config.log_dir + "/boost_sync_0.txt";
+            install_sink(boost::make_shared< boost::log::sinks::synchronous_sink< counting_file_backend > >(file_backend_));
+        }
+        else
+        {
+            // Open a rotating text file
+            strm_ = open_log_stream(config, config.log_dir + "/boost_sync.txt");
+            path_ = sink_output_path(config.sink, config.log_dir + "/boost_sync.txt");
+
+            // Create a text file sink
+            backend_ = boost::make_shared< counting_ostream_backend >();
+            backend_->add_stream(strm_);   // sink backend添加目标流
+            install_sink(boost::make_shared< boost::log::sinks::synchronous_sink< counting_ostream_backend > >(backend_));
+        }
+
+        // The --fanout sinks, flushed after every record like a socket appender
+        for (int i = 1; i < config.fanout; i++)
+        {
+            auto strm = boost::make_shared< output_sink_ostream >(std::unique_ptr< output_sink >(new socket_output_sink()));
+            auto backend = boost::make_shared< boost::log::sinks::text_ostream_backend >();
+            backend->add_stream(strm);
+            backend->auto_flush(true);
+            install_sink(boost::make_shared< boost::log::sinks::synchronous_sink< boost::log::sinks::text_ostream_backend > >(backend));
+            fanout_streams_.push_back(strm);
+        }
 
-int boost_sync_bench(int howmany, int threads_count, int queue_size)
-{
-    try
+        // Add some attributes too
+        logging::core::get()->add_global_attribute("TimeStamp", attrs::local_clock()); // 在core层绑定时间戳
+        logging::core::get()->add_global_attribute("RecordID", attrs::counter< unsigned int >()); // 绑定每条记录的ID
+        logging::core::get()->add_global_attribute("ThreadID", attrs::current_thread_id()); // 绑定当前线程的ID
+        logging::core::get()->set_filter(expr::attr< log_level >("Severity") >= log_threshold);
+    }
+
+    void log_one(const log_record &rec) override
     {
-        // Open a rotating text file
-        boost::shared_ptr< std::ostream > strm(new std::ofstream("test.log"));
-        if (!strm->good())
-            throw std::runtime_error("Failed to open a text log file");
+        BOOST_LOG_SEV(test_lg::get(), log_level(rec.level)) << rec;
+    }
 
-        // Create a text file sink
-        boost::shared_ptr< boost::log::sinks::synchronous_sink< boost::log::sinks::text_ostream_backend > > sink(
-            new boost::log::sinks::synchronous_sink< boost::log::sinks::text_ostream_backend >);    // 创建同步且后端输出为文本的sink，然后返回共享指针
+    void flush() override
+    {
+        for (auto& sink : sinks_)
+            sink->flush();
+    }
 
-        sink->locked_backend()->add_stream(strm);   // sink backend添加目标流
+    void teardown() override
+    {
+        // Leave the core clean for whichever backend runs next
+        for (auto& sink : sinks_)
+            logging::core::get()->remove_sink(sink);
+        logging::core::get()->set_global_attributes(logging::attribute_set());
+        logging::core::get()->reset_filter();
+        // rotate_file() closes, and so measures, the last file without starting another
+        sinks_.clear();
+        if (file_backend_)
+            file_backend_->rotate_file();
+        close_log_stream(strm_);
+        for (auto& strm : fanout_streams_)
+            strm->close();
+    }
 
+private:
+    template< typename SinkT >
+    void install_sink(boost::shared_ptr< SinkT > sink)
+    {
         sink->set_formatter
         (
             expr::format("%1%: [%2%] [%3%] - %4%")
@@ -133,46 +213,104 @@ int boost_sync_bench(int howmany, int threads_count, int queue_size)
 
         // Add it to the core
         logging::core::get()->add_sink(sink);   // 将创建的sink绑定core
+        sinks_.push_back(sink);
+    }
+
+    std::vector< boost::shared_ptr< logging::sinks::sink > > sinks_;
+    boost::shared_ptr< counting_ostream_backend > backend_;
+    boost::shared_ptr< counting_file_backend > file_backend_;
+    boost::shared_ptr< std::ostream > strm_;
+    std::vector< boost::shared_ptr< output_sink_ostream > > fanout_streams_;
+    std::string path_;
+};
+
+class boost_async_backend : public logger_backend {
+public:
+    const char *name() const override { return "boost_async"; }
+    const char *title() const override { return "Boost Log: Async Log"; }
+    bool is_async() const override { return true; }
+    // The stream position after the final flush is the number of bytes written
+    int64_t bytes_written() const override { return strm_ ? int64_t(strm_->tellp()) : -1; }
+    std::string output_path() const override { return path_; }
+    int64_t records_written() const override { return backend_ ? int64_t(backend_->records()) : -1; }
+    int64_t queue_capacity() const override { return queue_capacity_; }
+
+    void setup(const bench_config &config) override
+    {
+        // Open a rotating text file
+        strm_ = open_log_stream(config, config.log_dir + "/boost_asyn.txt");
+        path_ = sink_output_path(config.sink, config.log_dir + "/boost_asyn.txt");
+
+        backend_ = boost::make_shared< backend_t >();
+        backend_->add_stream(strm_);
+
+        // Create a text file sink. By default the queue is unbounded; with an explicit overflow
+        // policy it is a bounded_fifo_queue, whose capacity Boost.Log fixes at compile time.
+        if (config.overflow == overflow_block)
+            install_bounded_sink< boost::log::sinks::block_on_overflow >(config.queue_size);
+        else if (config.overflow == overflow_drop)
+            install_bounded_sink< boost::log::sinks::drop_on_overflow >(config.queue_size);
+        else
+        {
+            queue_capacity_ = 0;
+            install_sink< ordering_sink_t >(boost::make_shared< ordering_sink_t >(
+                backend_,
+                // We'll apply record ordering to ensure that records from different threads go sequentially in the file
+                keywords::order = logging::make_attr_ordering< unsigned int >("RecordID", std::less< unsigned int >())));
+        }
 
         // Add some attributes too
-        logging::core::get()->add_global_attribute("TimeStamp", attrs::local_clock()); // 在core层绑定时间戳
-        logging::core::get()->add_global_attribute("RecordID", attrs::counter< unsigned int >()); // 绑定每条记录的ID
-        logging::core::get()->add_global_attribute("ThreadID", attrs::current_thread_id()); // 绑定当前线程的ID
+        logging::core::get()->add_global_attribute("TimeStamp", attrs::local_clock());
+        logging::core::get()->add_global_attribute("RecordID", attrs::counter< unsigned int >());
+        logging::core::get()->set_filter(expr::attr< log_level >("Severity") >= log_threshold);
+    }
 
-        boost_mt(howmany, threads_count, &sync_thread_fun);
+    // Equivalent of BOOST_LOG_SCOPED_THREAD_TAG spanning the whole producer loop
+    void thread_begin() override
+    {
+        thread_tag() = logging::core::get()->add_thread_attribute(
+            "ThreadID", attrs::constant< boost::thread::id >(boost::this_thread::get_id())).first;
+    }
+
+    void thread_end() override { logging::core::get()->remove_thread_attribute(thread_tag()); }
 
-        return 0;
+    void log_one(const log_record &rec) override
+    {
+        BOOST_LOG_SEV(test_lg::get(), log_level(rec.level)) << rec;
     }
-    catch (std::exception& e)
+
+    void flush() override
     {
-        std::cout << "FAILURE: " << e.what() << std::endl;
-        return 1;
+        // Flush all buffered records
+        stop_and_flush_();
     }
-}
 
-int boost_async_bench(int howmany, int threads_count, int queue_size)
-{
-    try {
-        // Open a rotating text file
-        boost::shared_ptr< std::ostream > strm(new std::ofstream("logs/boost_asyn.txt"));
-        if (!strm->good())
-            throw std::runtime_error("Failed to open a text log file");
-
-        // Create a text file sink
-        typedef boost::log::sinks::text_ostream_backend backend_t;
-        typedef boost::log::sinks::asynchronous_sink<
-            backend_t,
-            boost::log::sinks::unbounded_ordering_queue<
-                logging::attribute_value_ordering< unsigned int, std::less< unsigned int > >
-            >
-        > sink_t;
-        boost::shared_ptr< sink_t > sink(new sink_t(
-            boost::make_shared< backend_t >(),
-            // We'll apply record ordering to ensure that records from different threads go sequentially in the file
-            keywords::order = logging::make_attr_ordering< unsigned int >("RecordID", std::less< unsigned int >())));
-
-        sink->locked_backend()->add_stream(strm);
+    void teardown() override
+    {
+        logging::core::get()->remove_sink(sink_);
+        logging::core::get()->set_global_attributes(logging::attribute_set());
+        logging::core::get()->reset_filter();
+        sink_.reset();
+        stop_and_flush_ = nullptr;
+        close_log_stream(strm_);
+    }
 
+private:
+    typedef counting_ostream_backend backend_t;
+    typedef boost::log::sinks::asynchronous_sink<
+        backend_t,
+        boost::log::sinks::unbounded_ordering_queue<
+            logging::attribute_value_ordering< unsigned int, std::less< unsigned int > >
+        >
+    > ordering_sink_t;
+
+    template< std::size_t CapacityV, typename OverflowT >
+    using bounded_sink_t = boost::log::sinks::asynchronous_sink<
+        backend_t, boost::log::sinks::bounded_fifo_queue< CapacityV, OverflowT > >;
+
+    template< typename SinkT >
+    void install_sink(boost::shared_ptr< SinkT > sink)
+    {
         sink->set_formatter
         (
             expr::format("%1%: [%2%] [%3%] - %4%")
@@ -184,24 +322,44 @@ int boost_async_bench(int howmany, int threads_count, int queue_size)
 
         // Add it to the core
         logging::core::get()->add_sink(sink);
+        sink_ = sink;
+        stop_and_flush_ = [sink] { sink->stop(); sink->flush(); };
+    }
 
-        // Add some attributes too
-        logging::core::get()->add_global_attribute("TimeStamp", attrs::local_clock());
-        logging::core::get()->add_global_attribute("RecordID", attrs::counter< unsigned int >());
-
-        boost_mt(howmany, threads_count, &async_thread_fun);
-
-        // Flush all buffered records
-        sink->stop();
-        sink->flush();
+    // Rounds the requested queue size up to the nearest capacity instantiated here
+    template< typename OverflowT >
+    void install_bounded_sink(int queue_size)
+    {
+        if (queue_size <= 1024)
+            install_bounded_sink< 1024, OverflowT >();
+        else if (queue_size <= 16384)
+            install_bounded_sink< 16384, OverflowT >();
+        else if (queue_size <= 131072)
+            install_bounded_sink< 131072, OverflowT >();
+        else
+            install_bounded_sink< 1048576, OverflowT >();
+    }
 
-        return 0;
+    template< std::size_t CapacityV, typename OverflowT >
+    void install_bounded_sink()
+    {
+        queue_capacity_ = int64_t(CapacityV);
+        install_sink(boost::make_shared< bounded_sink_t< CapacityV, OverflowT > >(backend_));
     }
-    catch (std::exception &ex) {
-        std::cerr << "Error: " << ex.what() << std::endl;
-        perror("Last error");
-        return 1;
+
+    static logging::attribute_set::iterator &thread_tag()
+    {
+        static thread_local logging::attribute_set::iterator tag;
+        return tag;
     }
 
-    return 0;
-}
\ No newline at end of file
+    boost::shared_ptr< logging::sinks::sink > sink_;
+    boost::shared_ptr< backend_t > backend_;
+    std::function< void() > stop_and_flush_;
+    boost::shared_ptr< std::ostream > strm_;
+    std::string path_;
+    int64_t queue_capacity_ = 0;
+};
+
+REGISTER_LOGGER_BACKEND(boost_sync_backend)
+REGISTER_LOGGER_BACKEND(boost_async_backend)
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "latency_histogram.h"
+#include "workload.h"
+
+// End-to-end mode prefixes every message with "E2E <producer>:<seq>:<send ticks> ". A reader
+// thread tails the backend's output file and, for each line it finds, measures the time
+// from the send timestamp until the line became visible in the file.
+
+// Per-producer helper that builds the stamped copy of a record right before it is logged
+class e2e_stamper {
+public:
+    e2e_stamper(int producer, int max_text_size) : producer_(producer), buf_(size_t(max_text_size) + 64) {}
+
+    const log_record &stamp(const log_record &rec) {
+        auto res = fmt::format_to_n(buf_.data(), 64, "E2E {}:{}:{} ", producer_, seq_++, latency_now());
+        memcpy(res.out, rec.text, rec.text_size);
+        stamped_ = rec;
+        stamped_.text = buf_.data();
+        stamped_.text_size = uint32_t(res.out - buf_.data()) + rec.text_size;
+        return stamped_;
+    }
+
+private:
+    int producer_;
+    uint64_t seq_ = 0;
+    std::vector<char> buf_;
+    log_record stamped_;
+};
+
+struct e2e_stats {
+    latency_histogram latency;
+    uint64_t lines = 0;
+    // A producer's record appeared with a sequence number not above its previous one
+    uint64_t seq_violations = 0;
+    // A record appeared after one that was sent later (by any producer)
+    uint64_t send_order_violations = 0;
+};
+
+class e2e_reader {
+public:
+    e2e_reader(const std::string &path, int producers) : path_(path), last_seq_(size_t(producers), -1) {
+        thread_ = std::thread(&e2e_reader::run, this);
+    }
+
+    // Call once the backend has flushed everything; reads up to end of file and stops.
+    // Throws if the file never appeared, rather than reporting an empty run.
+    e2e_stats finish() {
+        stop_.store(true);
+        thread_.join();
+        if (!opened_)
+            throw std::runtime_error("End-to-end mode found no output file at " + path_);
+        return stats_;
+    }
+
+private:
+    void run() {
+        int fd = -1;
+        std::string pending;
+        char chunk[1 << 16];
+        for (;;) {
+            bool stopping = stop_.load();
+            if (fd < 0)
+                fd = open(path_.c_str(), O_RDONLY);    // the backend may create it lazily
+
+            ssize_t n = fd >= 0 ? read(fd, chunk, sizeof(chunk)) : 0;
+            if (n > 0) {
+                uint64_t seen = latency_now();
+                pending.append(chunk, size_t(n));
+                size_t line_start = 0, eol;
+                while ((eol = pending.find('\n', line_start)) != std::string::npos) {
+                    parse_line(pending.c_str() + line_start, eol - line_start, seen);
+                    line_start = eol + 1;
+                }
+                pending.erase(0, line_start);
+                continue;
+            }
+            if (stopping)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+        if (fd >= 0) {
+            opened_ = true;
+            close(fd);
+        }
+    }
+
+    // Only [line, line + size) is searched, so an unstamped line such as glog's file
+    // header cannot pick up the stamp on the line after it
+    void parse_line(const char *line, size_t size, uint64_t seen) {
+        const char *marker = static_cast<const char *>(memmem(line, size, "E2E ", 4));
+        if (!marker)
+            return;
+        char *p;
+        unsigned long producer = strtoul(marker + 4, &p, 10);
+        long long seq = strtoll(p + 1, &p, 10);
+        uint64_t sent = strtoull(p + 1, nullptr, 10);
+
+        stats_.lines++;
+        stats_.latency.record(seen > sent ? seen - sent : 0);
+        if (producer < last_seq_.size()) {
+            if (seq <= last_seq_[producer])
+                stats_.seq_violations++;
+            last_seq_[producer] = seq;
+        }
+        if (sent < max_sent_)
+            stats_.send_order_violations++;
+        max_sent_ = std::max(max_sent_, sent);
+    }
+
+    std::string path_;
+    std::vector<long long> last_seq_;
+    uint64_t max_sent_ = 0;
+    e2e_stats stats_;
+    bool opened_ = false;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
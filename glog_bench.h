@@ -1,40 +1,289 @@
 #include <glog/logging.h>
+#include <dirent.h>
+#include <unistd.h>
 
-void glog_thread_fun(int howmany) {
-    for (int i = 0; i < howmany; i++) {
-        LOG(INFO) << "Hello logger: msg number x";
-        // LOG(INFO) << "Hello logger: msg number " << 1.23;
-        // LOG(INFO) << "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789";
-    }
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "bench_backend.h"
+#include "rotation.h"
+
+// Program name glog logs under, and the basename of its <program>.INFO link
+const char *const glog_program_name = "glog_bench.h";
+
+// The thread id glog prints in its prefix: the kernel tid on Linux
+long glog_thread_id() {
+#if defined(__linux__)
+    static thread_local long tid = long(syscall(SYS_gettid));
+#else
+    static thread_local long tid = long(std::hash<std::thread::id>()(std::this_thread::get_id()) % 1000000);
+#endif
+    return tid;
 }
 
-void glog_mt(int howmany, int thread_count) {
-    using std::chrono::high_resolution_clock;
-    std::vector<std::thread> threads;
-    auto start = high_resolution_clock::now();
+// Receives every record through glog's LogSink hook when file logging is switched off,
+// and writes it to a shared output sink in glog's own line format
+class glog_output_sink : public google::LogSink {
+public:
+    explicit glog_output_sink(std::unique_ptr<output_sink> out) : out_(std::move(out)) {}
+
+    using google::LogSink::send;
+
+    // "I20261017 15:37:37.123456 12345 file.cc:123] message", as glog writes its files,
+    // with the year only under FLAGS_log_year_in_prefix like glog itself
+    void send(google::LogSeverity severity, const char *, const char *base_filename, int line, const google::LogMessageTime &time,
+              const char *message, size_t message_len) override {
+        const struct ::tm &tm_time = time.tm();
+        fmt::memory_buffer buf;
+        buf.push_back("IWEF"[severity]);
+        if (FLAGS_log_year_in_prefix)
+            fmt::format_to(std::back_inserter(buf), "{:04}", tm_time.tm_year + 1900);
+        fmt::format_to(std::back_inserter(buf), "{:02}{:02} {:02}:{:02}:{:02}.{:06} {:5} {}:{}] ", tm_time.tm_mon + 1, tm_time.tm_mday,
+                       tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec, time.usec(), glog_thread_id(), base_filename, line);
+        buf.append(message, message + message_len);
+        buf.push_back('\n');
+        // glog calls sinks from every logging thread at once
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->write(buf.data(), buf.size());
+        records_++;
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->flush();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_->close();
+    }
+
+    uint64_t bytes() const { return out_->bytes(); }
+    uint64_t records() const { return records_; }
+
+private:
+    std::mutex mutex_;
+    std::unique_ptr<output_sink> out_;
+    uint64_t records_ = 0;
+};
+
+// glog has no hook for opening a log file, so for --rotate a thread polls the
+// <program>.INFO link, which glog repoints at every new file
+class glog_rotation_watcher {
+public:
+    ~glog_rotation_watcher() { stop(); }
+
+    void start(const std::string &link) {
+        running_ = true;
+        thread_ = std::thread([this, link] {
+            std::string current;
+            while (running_.load(std::memory_order_relaxed)) {
+                char target[4096];
+                ssize_t n = readlink(link.c_str(), target, sizeof(target) - 1);
+                if (n > 0 && current.compare(0, std::string::npos, target, size_t(n)) != 0) {
+                    current.assign(target, size_t(n));
+                    rotation_log.file_opened();
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+
+    void stop() {
+        running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+private:
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
 
-    int msgs_per_thread = howmany / thread_count;
-    int msgs_per_thread_mod = howmany % thread_count;
-    for (int t = 0; t < thread_count; ++t) {
-        if (t == 0 && msgs_per_thread_mod)
-            threads.push_back(
-                std::thread(glog_thread_fun, msgs_per_thread + msgs_per_thread_mod));
-        else
-            threads.push_back(std::thread(glog_thread_fun, msgs_per_thread));
+// Counts the records glog accepted, whether or not they reached a file
+class glog_record_counter : public google::LogSink {
+public:
+    using google::LogSink::send;
+
+    void send(google::LogSeverity, const char *, const char *, int, const google::LogMessageTime &, const char *, size_t) override {
+        records_.fetch_add(1, std::memory_order_relaxed);
     }
 
-    for (auto &t : threads) {
-        t.join();
-    };
+    uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> records_{0};
+};
+
+// glog's own INFO files in dir, <base><time>.<pid> for the base name one run logs to
+std::set<std::string> glog_info_files(const std::string &dir, const std::string &base) {
+    std::set<std::string> files;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d))
+            if (strncmp(entry->d_name, base.c_str(), base.size()) == 0)
+                files.insert(entry->d_name);
+        closedir(d);
+    }
+    return files;
+}
 
-    auto delta = high_resolution_clock::now() - start;
-    auto delta_d = duration_cast<duration<double>>(delta).count();
-    std::cout << "Elapsed: " << delta_d << "secs\t" << int(howmany / delta_d) * (79+74) / 1024 / 1024 << " MB/sec" << std::endl << std::endl;
+// Log lines in the INFO files that are not in `before`; glog's file header lines do not
+// start with a severity letter and a digit
+uint64_t count_glog_records(const std::string &dir, const std::string &base, const std::set<std::string> &before) {
+    uint64_t lines = 0;
+    for (auto &name : glog_info_files(dir, base)) {
+        if (before.count(name))
+            continue;
+        FILE *f = fopen((dir + "/" + name).c_str(), "r");
+        if (!f)
+            continue;
+        char line[4096];
+        bool at_start = true;
+        while (fgets(line, sizeof(line), f)) {
+            if (at_start && line[0] && strchr("IWEF", line[0]) && isdigit((unsigned char)line[1]))
+                lines++;
+            at_start = strchr(line, '\n') != nullptr;
+        }
+        fclose(f);
+    }
+    return lines;
 }
 
-void glog_sync_bench(int howmany, int thread_count) {
-    FLAGS_log_dir = "/Users/jimmyliu/VSCodeProjects/log_analysist_tool/build/logs";
-    google::InitGoogleLogging("glog_bench.h");
-    glog_mt(howmany, thread_count);
-    google::ShutdownGoogleLogging();
-}
\ No newline at end of file
+class glog_sync_backend : public logger_backend {
+public:
+    const char *name() const override { return "glog_sync"; }
+    const char *title() const override { return "Glog: Sync Log"; }
+
+    int64_t bytes_written() const override { return sink_ ? int64_t(sink_->bytes()) : -1; }
+    // With --rotate, counted from the files afterwards: glog can lose records while rotating
+    int64_t records_written() const override {
+        if (counter_)
+            return int64_t(rotated_records_);
+        return sink_ ? int64_t(sink_->records()) : -1;
+    }
+
+    // glog names its files after the run's base name and time, but keeps <program>.INFO pointing at the current one
+    std::string output_path() const override { return sink_ ? path_ : FLAGS_log_dir + "/" + glog_program_name + ".INFO"; }
+    bool supports_rotation() const override { return true; }
+
+    void setup(const bench_config &config) override {
+        FLAGS_log_dir = config.log_dir;
+        FLAGS_stderrthreshold = google::GLOG_FATAL;    // keep ERROR records off the console
+        if (auto out = make_backend_sink(config, config.log_dir + "/glog_output.txt")) {
+            // An empty base filename turns glog's own file off; it stays off for the process
+            for (int severity = google::GLOG_INFO; severity <= google::GLOG_FATAL; severity++)
+                google::SetLogDestination(severity, "");
+            path_ = sink_output_path(config.sink, config.log_dir + "/glog_output.txt");
+            // The sink writes the prefix itself, so glog need not format one per record too
+            saved_log_prefix_ = FLAGS_log_prefix;
+            FLAGS_log_prefix = false;
+            sink_.reset(new glog_output_sink(std::move(out)));
+            google::AddLogSink(sink_.get());
+        }
+        else {
+            unlink(output_path().c_str());    // drop the link to the previous run's file
+            // glog names its files to the second and opens them exclusively, so a second run in
+            // this process (--scaling, --find-max-rate) within the same second would lose every
+            // record under the default name; each run gets its own base name instead
+            static int runs = 0;
+            base_ = "glog_bench." + std::to_string(++runs) + ".";
+            // SetLogDestination() creates the file object, which takes its link name from the
+            // program name; before InitGoogleLogging() that is "UNKNOWN", so set it explicitly
+            for (int severity = google::GLOG_INFO; severity <= google::GLOG_FATAL; severity++) {
+                google::SetLogDestination(severity,
+                                          (config.log_dir + "/" + base_ + google::GetLogSeverityName(severity) + ".").c_str());
+                google::SetLogSymlink(severity, glog_program_name);
+            }
+        }
+        for (int i = 1; i < config.fanout; i++) {
+            fanout_sinks_.emplace_back(new glog_output_sink(std::unique_ptr<output_sink>(new socket_output_sink())));
+            google::AddLogSink(fanout_sinks_.back().get());
+        }
+        if (config.rotate_bytes > 0) {
+            // glog rotates in whole megabytes, so small sizes round up to 1 MB
+            saved_max_log_size_ = FLAGS_max_log_size;
+            FLAGS_max_log_size = decltype(FLAGS_max_log_size)(std::max<int64_t>(1, (config.rotate_bytes + (1 << 20) - 1) >> 20));
+            watcher_.start(output_path());
+            files_before_ = glog_info_files(config.log_dir, info_base());
+            counter_.reset(new glog_record_counter());
+            google::AddLogSink(counter_.get());
+        }
+        google::InitGoogleLogging(glog_program_name);
+    }
+
+    void log_one(const log_record &rec) override {
+        // glog has no DEBUG severity; VLOG(1) is its runtime-filtered equivalent
+        switch (rec.level) {
+        case level_debug: VLOG(1) << rec; break;
+        case level_info: LOG(INFO) << rec; break;
+        case level_warn: LOG(WARNING) << rec; break;
+        default: LOG(ERROR) << rec; break;
+        }
+    }
+
+    void flush() override {
+        google::FlushLogFiles(google::GLOG_INFO);
+        if (sink_)
+            sink_->flush();
+    }
+
+    void teardown() override {
+        if (sink_) {
+            google::RemoveLogSink(sink_.get());
+            sink_->close();
+            FLAGS_log_prefix = saved_log_prefix_;
+        }
+        for (auto &fanout_sink : fanout_sinks_) {
+            google::RemoveLogSink(fanout_sink.get());
+            fanout_sink->close();
+        }
+        if (counter_)
+            google::RemoveLogSink(counter_.get());
+        google::ShutdownGoogleLogging();
+        watcher_.stop();
+        if (saved_max_log_size_)
+            FLAGS_max_log_size = saved_max_log_size_;
+
+        if (counter_) {
+            // glog names files to the second and will not reuse a name, so a second
+            // rotation within one second fails and records are lost until the next second
+            rotated_records_ = count_glog_records(FLAGS_log_dir, info_base(), files_before_);
+            if (rotated_records_ < counter_->records())
+                std::cerr << "glog_sync: " << counter_->records() - rotated_records_
+                          << " records lost: glog cannot open more than one log file per second" << std::endl;
+        }
+    }
+
+private:
+    std::string info_base() const { return base_ + google::GetLogSeverityName(google::GLOG_INFO) + "."; }
+
+    std::unique_ptr<glog_output_sink> sink_;
+    std::vector<std::unique_ptr<glog_output_sink>> fanout_sinks_;
+    glog_rotation_watcher watcher_;
+    std::unique_ptr<glog_record_counter> counter_;
+    std::set<std::string> files_before_;
+    uint64_t rotated_records_ = 0;
+    decltype(FLAGS_max_log_size) saved_max_log_size_ = 0;
+    bool saved_log_prefix_ = true;
+    std::string path_;
+    std::string base_;
+};
+
+REGISTER_LOGGER_BACKEND(glog_sync_backend)
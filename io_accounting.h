@@ -0,0 +1,110 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#endif
+
+// Bytes and records handed to the output file by a backend's own counting sink
+struct io_counter {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> records{0};
+};
+
+// fsync()/fdatasync() calls made anywhere in the process, counted by the wrappers below
+std::atomic<uint64_t> io_fsync_calls{0};
+
+#if defined(__linux__)
+// Defined in the executable, these take precedence over libc for every shared library
+// that calls fsync/fdatasync through the PLT (spdlog's file_helper::sync, glog, ...).
+extern "C" int fsync(int fd) {
+    static int (*real_fsync)(int) = (int (*)(int))dlsym(RTLD_NEXT, "fsync");
+    io_fsync_calls.fetch_add(1, std::memory_order_relaxed);
+    return real_fsync(fd);
+}
+
+extern "C" int fdatasync(int fd) {
+    static int (*real_fdatasync)(int) = (int (*)(int))dlsym(RTLD_NEXT, "fdatasync");
+    io_fsync_calls.fetch_add(1, std::memory_order_relaxed);
+    return real_fdatasync(fd);
+}
+#endif
+
+// Process-wide I/O counters. write_calls / write_chars come from /proc/self/io and are
+// only available on Linux (has_proc is false elsewhere).
+struct io_snapshot {
+    bool has_proc = false;
+    uint64_t write_calls = 0;
+    uint64_t write_chars = 0;
+    uint64_t fsync_calls = 0;
+};
+
+io_snapshot take_io_snapshot() {
+    io_snapshot snap;
+    snap.fsync_calls = io_fsync_calls.load(std::memory_order_relaxed);
+
+    FILE *f = fopen("/proc/self/io", "r");
+    if (!f)
+        return snap;
+    char key[32];
+    unsigned long long value;
+    while (fscanf(f, "%31[^:]: %llu\n", key, &value) == 2) {
+        if (strcmp(key, "syscw") == 0)
+            snap.write_calls = value;
+        else if (strcmp(key, "wchar") == 0)
+            snap.write_chars = value;
+    }
+    fclose(f);
+    snap.has_proc = true;
+    return snap;
+}
+
+// stat() fallback for backends without a counting sink: sizes of the regular files in the
+// log directory, so that new files and files that grew during a run can be told apart.
+class dir_usage {
+public:
+    explicit dir_usage(const std::string &dir) {
+        DIR *d = opendir(dir.c_str());
+        if (!d)
+            return;
+        while (struct dirent *entry = readdir(d)) {
+            std::string path = dir + "/" + entry->d_name;
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                files_[path] = file_state{st.st_mtime, uint64_t(st.st_size)};
+        }
+        closedir(d);
+    }
+
+    // Bytes written between before and this snapshot. A file that shrank or kept its size
+    // but was modified is assumed to have been truncated and rewritten.
+    uint64_t bytes_since(const dir_usage &before) const {
+        uint64_t total = 0;
+        for (auto &f : files_) {
+            auto old = before.files_.find(f.first);
+            if (old == before.files_.end())
+                total += f.second.size;
+            else if (f.second.size > old->second.size)
+                total += f.second.size - old->second.size;
+            else if (f.second.mtime != old->second.mtime)
+                total += f.second.size;
+        }
+        return total;
+    }
+
+private:
+    struct file_state {
+        time_t mtime;
+        uint64_t size;
+    };
+    std::map<std::string, file_state> files_;
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_HAS_RDTSC 1
+#endif
+
+// Time one out of every latency_sample_every log calls (0 disables sampling)
+int latency_sample_every = 1;
+// Read the TSC instead of steady_clock when the CPU has one
+bool latency_use_rdtsc = false;
+// Conversion factor from latency_now() ticks to nanoseconds, see latency_clock_init()
+double latency_ns_per_tick = 1.0;
+
+inline uint64_t latency_now() {
+#ifdef LATENCY_HAS_RDTSC
+    if (latency_use_rdtsc)
+        return __rdtsc();
+#endif
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+// Must be called once before any sampling. Calibrates the TSC against steady_clock.
+void latency_clock_init() {
+#ifndef LATENCY_HAS_RDTSC
+    latency_use_rdtsc = false;
+#endif
+    if (!latency_use_rdtsc) {
+        using period = std::chrono::steady_clock::period;
+        latency_ns_per_tick = 1e9 * period::num / period::den;
+        return;
+    }
+
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = latency_now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    uint64_t tsc_end = latency_now();
+    auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start).count();
+    latency_ns_per_tick = double(wall_ns) / double(tsc_end - tsc_start);
+}
+
+const char *latency_clock_name() {
+    return latency_use_rdtsc ? "rdtsc" : "steady_clock";
+}
+
+// Log-bucketed histogram in the spirit of HdrHistogram: values below 32 get their own
+// bucket, larger values are grouped by magnitude with 16 linear sub-buckets each,
+// which keeps the relative error under 6.25% over the full 64-bit range.
+class latency_histogram {
+public:
+    static constexpr int sub_bucket_bits = 4;
+    static constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+    static constexpr int bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    static int bucket_index(uint64_t value) {
+        if (value < 2 * sub_bucket_count)
+            return int(value);
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - sub_bucket_bits;
+        return shift * sub_bucket_count + int(value >> shift);
+    }
+
+    // Largest value that maps to the given bucket
+    static uint64_t bucket_upper_bound(int index) {
+        if (index < 2 * sub_bucket_count)
+            return uint64_t(index);
+        int shift = index / sub_bucket_count - 1;
+        uint64_t mantissa = uint64_t(index - shift * sub_bucket_count);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    void record(uint64_t value) {
+        counts_[bucket_index(value)]++;
+        total_++;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    // Used to rebuild a histogram from raw bucket counts
+    void add_to_bucket(int index, uint64_t n, uint64_t min_value, uint64_t max_value) {
+        counts_[index] += n;
+        total_ += n;
+        min_ = std::min(min_, min_value);
+        max_ = std::max(max_, max_value);
+    }
+
+    void merge(const latency_histogram &other) {
+        for (int i = 0; i < bucket_count; i++)
+            counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t count_at(int index) const { return counts_[index]; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+
+    // Approximate sum of all recorded values of at least threshold, using bucket midpoints
+    double sum_above(uint64_t threshold) const {
+        double sum = 0;
+        for (int i = bucket_index(threshold); i < bucket_count; i++) {
+            if (!counts_[i])
+                continue;
+            uint64_t lower = i ? bucket_upper_bound(i - 1) + 1 : 0;
+            uint64_t upper = std::min(bucket_upper_bound(i), max_);
+            sum += double(counts_[i]) * (double(lower) + double(upper)) / 2;
+        }
+        return sum;
+    }
+
+    // Value at the given quantile (0.0 - 1.0), reported as the bucket upper bound
+    uint64_t percentile(double q) const {
+        if (total_ == 0)
+            return 0;
+        uint64_t rank = uint64_t(q * double(total_));
+        if (rank >= total_)
+            rank = total_ - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < bucket_count; i++) {
+            seen += counts_[i];
+            if (seen > rank)
+                return std::min(bucket_upper_bound(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    std::array<uint64_t, bucket_count> counts_{};
+    uint64_t total_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+// Histogram that many threads can fold their private histograms into without a lock
+class shared_latency_histogram {
+public:
+    void merge(const latency_histogram &h) {
+        if (h.count() == 0)
+            return;
+        for (int i = 0; i < latency_histogram::bucket_count; i++)
+            if (uint64_t c = h.count_at(i))
+                counts_[i].fetch_add(c, std::memory_order_relaxed);
+        total_.fetch_add(h.count(), std::memory_order_relaxed);
+
+        uint64_t cur = max_.load(std::memory_order_relaxed);
+        while (h.max() > cur && !max_.compare_exchange_weak(cur, h.max(), std::memory_order_relaxed))
+            ;
+        cur = min_.load(std::memory_order_relaxed);
+        while (h.min() < cur && !min_.compare_exchange_weak(cur, h.min(), std::memory_order_relaxed))
+            ;
+    }
+
+    // Only meaningful once all writer threads have been joined
+    latency_histogram snapshot() const {
+        latency_histogram h;
+        uint64_t lo = min_.load(std::memory_order_relaxed);
+        uint64_t hi = max_.load(std::memory_order_relaxed);
+        for (int i = 0; i < latency_histogram::bucket_count; i++)
+            if (uint64_t c = counts_[i].load(std::memory_order_relaxed))
+                h.add_to_bucket(i, c, lo, hi);
+        return h;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, latency_histogram::bucket_count> counts_{};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> min_{UINT64_MAX};
+    std::atomic<uint64_t> max_{0};
+};
+
+// A sampled call slower than the capture threshold: when it started and how long it took
+struct latency_spike {
+    uint64_t start;
+    uint64_t ticks;
+};
+
+// Per-thread sampler. Keeps its own histogram so the hot path never touches shared state;
+// call publish() once the thread is done logging.
+class latency_recorder {
+public:
+    explicit latency_recorder(int sample_every = latency_sample_every)
+        : sample_every_(sample_every), countdown_(sample_every) {}
+
+    template <typename F>
+    inline void measure(F &&log_call) {
+        if (sample_every_ <= 0 || --countdown_ != 0) {
+            log_call();
+            return;
+        }
+        countdown_ = sample_every_;
+        uint64_t start = latency_now();
+        log_call();
+        record(start, latency_now() - start);
+    }
+
+    // Also keep the start time of up to max_spikes sampled calls slower than threshold_ticks;
+    // for measure_since() that is the intended send time
+    void capture_spikes(uint64_t threshold_ticks, size_t max_spikes) {
+        spike_ticks_ = threshold_ticks;
+        max_spikes_ = max_spikes;
+        spikes_.reserve(max_spikes);
+    }
+
+    const std::vector<latency_spike> &spikes() const { return spikes_; }
+
+    // Open-loop variant: latency runs from the record's intended send time, not the call
+    template <typename F>
+    inline void measure_since(uint64_t intended, F &&log_call) {
+        log_call();
+        if (sample_every_ <= 0 || --countdown_ != 0)
+            return;
+        countdown_ = sample_every_;
+        record(intended, latency_now() - intended);
+    }
+
+    void publish(shared_latency_histogram *target) const {
+        if (target)
+            target->merge(hist_);
+    }
+
+private:
+    inline void record(uint64_t start, uint64_t elapsed) {
+        hist_.record(elapsed);
+        if (elapsed > spike_ticks_ && spikes_.size() < max_spikes_)
+            spikes_.push_back({start, elapsed});
+    }
+
+    latency_histogram hist_;
+    int sample_every_;
+    int countdown_;
+    uint64_t spike_ticks_ = UINT64_MAX;
+    size_t max_spikes_ = 0;
+    std::vector<latency_spike> spikes_;
+};
+
+void print_latency_report(const std::string &name, const latency_histogram &h) {
+    auto ns = [](uint64_t ticks) { return uint64_t(double(ticks) * latency_ns_per_tick); };
+    std::cout << "Latency [" << name << "] (" << latency_clock_name() << ", " << h.count() << " samples, ns): "
+              << "p50=" << ns(h.percentile(0.50))
+              << " p99=" << ns(h.percentile(0.99))
+              << " p99.9=" << ns(h.percentile(0.999))
+              << " max=" << ns(h.max()) << std::endl;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+#include <glog/logging.h>
+#include <boost/format.hpp>
+#include <boost/smart_ptr/make_shared_object.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/log/sources/severity_logger.hpp>
+
+#include <fmt/format.h>
+
+#include "bench_backend.h"
+
+// --micro: ns per call of single log statements in a tight loop, no producer threads and
+// no file. Compares each library's enabled call against the same call disabled at run
+// time (level check) and removed at compile time (macros, NDEBUG, static_log below), and
+// times fmt, std::ostream and boost::format on the same records with no logger at all.
+struct micro_spec {
+    bool enabled = false;
+    int iterations = 10000000;
+    int trials = 5;
+};
+
+// Applies a --micro / --micro-iters option; false if arg is not one
+bool parse_micro_option(const std::string &arg, micro_spec &spec) {
+    if (arg == "--micro")
+        spec.enabled = true;
+    else if (arg.rfind("--micro-iters=", 0) == 0)
+        spec.iterations = std::max(atoi(arg.c_str() + 14), 1);
+    else
+        return false;
+    return true;
+}
+
+// Compile-time floor of static_log(): call sites below it are specialised to nothing
+constexpr log_level micro_compile_threshold = log_threshold;
+
+template <bool Enabled>
+struct static_level_guard {
+    template <typename F>
+    static void log(F &&log_call) { log_call(); }
+};
+
+template <>
+struct static_level_guard<false> {
+    template <typename F>
+    static void log(F &&) {}
+};
+
+// A log statement whose level is a template argument, so a disabled one costs nothing
+template <log_level Level, typename F>
+inline void static_log(F &&log_call) {
+    static_level_guard<(Level >= micro_compile_threshold)>::log(std::forward<F>(log_call));
+}
+
+// Makes the compiler assume value is read and memory changed, so neither the loop nor
+// the work feeding it can be hoisted or deleted
+template <typename T>
+inline void micro_keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Median ns per call over the trials; body gets the workload's records in turn
+template <typename F>
+double micro_ns_per_call(const micro_spec &spec, const workload &work, F &&body) {
+    const log_record *records = work.records();
+    int count = work.size();
+    std::vector<double> trials;
+    for (int t = 0; t < spec.trials; t++) {
+        int r = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < spec.iterations; i++) {
+            body(records[r]);
+            micro_keep(r);
+            if (++r == count)
+                r = 0;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        trials.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / spec.iterations);
+    }
+    std::sort(trials.begin(), trials.end());
+    return trials[trials.size() / 2];
+}
+
+void print_micro_row(const char *library, const std::string &call, const char *filtering, double ns) {
+    std::cout << std::left << std::setw(8) << library << std::setw(46) << call << std::setw(22) << filtering << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << ns << std::defaultfloat << std::endl;
+}
+
+void run_spdlog_micro(const micro_spec &spec, const workload &work) {
+    auto logger = std::make_shared<spdlog::logger>("micro_logger", std::make_shared<spdlog::sinks::null_sink_mt>());
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v");
+    logger->set_level(spdlog::level::info);
+    const std::string &pattern = work.format_pattern();
+
+    print_micro_row("spdlog", "logger->info() into null_sink", "enabled", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        with_record_args(rec, [&](spdlog::string_view_t text, const auto &...args) { logger->info(SPDLOG_FMT_RUNTIME(pattern), text, args...); });
+    }));
+    print_micro_row("spdlog", "logger->debug()", "set_level(info)", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        with_record_args(rec, [&](spdlog::string_view_t text, const auto &...args) { logger->debug(SPDLOG_FMT_RUNTIME(pattern), text, args...); });
+    }));
+    // SPDLOG_ACTIVE_LEVEL defaults to info, so the TRACE macro expands to nothing
+    print_micro_row("spdlog", "SPDLOG_LOGGER_TRACE()", SPDLOG_ACTIVE_LEVEL > SPDLOG_LEVEL_TRACE ? "SPDLOG_ACTIVE_LEVEL" : "compiled in (!)",
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) {
+                        with_record_args(rec, [&](spdlog::string_view_t text, const auto &...args) {
+                            // Unused once the macro expands to nothing
+                            (void)text;
+                            (void)std::initializer_list<int>{((void)args, 0)...};
+                            SPDLOG_LOGGER_TRACE(logger, SPDLOG_FMT_RUNTIME(pattern), text, args...);
+                        });
+                    }));
+    print_micro_row("spdlog", "static_log<level_debug>(logger->debug())", "template guard", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        static_log<level_debug>([&] {
+            with_record_args(rec, [&](spdlog::string_view_t text, const auto &...args) { logger->debug(SPDLOG_FMT_RUNTIME(pattern), text, args...); });
+        });
+    }));
+}
+
+// Takes every record glog hands it and does nothing with it
+class glog_null_sink : public google::LogSink {
+public:
+    using google::LogSink::send;
+
+    void send(google::LogSeverity, const char *, const char *, int, const google::LogMessageTime &, const char *, size_t) override {}
+};
+
+// glog's files are switched off, so the enabled row formats each record and hands it to
+// glog_null_sink only. Like glog_sync's --sink modes, this lasts for the process.
+void run_glog_micro(const micro_spec &spec, const workload &work) {
+    auto saved_minloglevel = FLAGS_minloglevel;
+    auto saved_v = FLAGS_v;
+    auto saved_stderrthreshold = FLAGS_stderrthreshold;
+    for (int severity = google::GLOG_INFO; severity <= google::GLOG_FATAL; severity++)
+        google::SetLogDestination(severity, "");
+    FLAGS_stderrthreshold = google::GLOG_FATAL;
+    glog_null_sink sink;
+    google::AddLogSink(&sink);
+    google::InitGoogleLogging("glog_bench.h");
+
+    FLAGS_minloglevel = google::GLOG_INFO;
+    print_micro_row("glog", "LOG(INFO) into a discarding LogSink", "enabled",
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) { LOG(INFO) << rec; }));
+    FLAGS_minloglevel = google::GLOG_WARNING;
+    FLAGS_v = 0;
+
+    // glog builds the whole message and only drops it when the LogMessage is destroyed
+    print_micro_row("glog", "LOG(INFO)", "minloglevel=WARNING", micro_ns_per_call(spec, work, [&](const log_record &rec) { LOG(INFO) << rec; }));
+    print_micro_row("glog", "VLOG(1)", "v=0", micro_ns_per_call(spec, work, [&](const log_record &rec) { VLOG(1) << rec; }));
+#ifdef NDEBUG
+    const char *dlog_filtering = "NDEBUG";
+    const char *dcheck_filtering = "NDEBUG";
+#else
+    const char *dlog_filtering = "no NDEBUG: minloglevel";
+    const char *dcheck_filtering = "condition evaluated";
+#endif
+    print_micro_row("glog", "DLOG(INFO)", dlog_filtering, micro_ns_per_call(spec, work, [&](const log_record &rec) { DLOG(INFO) << rec; }));
+    print_micro_row("glog", "DCHECK(rec.text_size > 0)", dcheck_filtering,
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) { DCHECK(rec.text_size > 0) << rec; }));
+    print_micro_row("glog", "static_log<level_debug>(LOG(INFO))", "template guard",
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) { static_log<level_debug>([&] { LOG(INFO) << rec; }); }));
+
+    google::RemoveLogSink(&sink);
+    google::ShutdownGoogleLogging();
+    FLAGS_minloglevel = saved_minloglevel;
+    FLAGS_v = saved_v;
+    FLAGS_stderrthreshold = saved_stderrthreshold;
+}
+
+// A sink with no streams formats each record and writes it nowhere
+void run_boost_micro(const micro_spec &spec, const workload &work) {
+    namespace logging = boost::log;
+    namespace expr = boost::log::expressions;
+    typedef boost::log::sinks::synchronous_sink< boost::log::sinks::text_ostream_backend > sink_t;
+
+    auto sink = boost::make_shared< sink_t >();
+    sink->set_formatter(expr::stream << expr::smessage);
+    logging::core::get()->add_sink(sink);
+    logging::core::get()->set_filter(expr::attr< log_level >("Severity") >= log_threshold);
+    boost::log::sources::severity_logger< log_level > lg;
+
+    print_micro_row("boost", "BOOST_LOG_SEV(info) into a stream-less sink", "enabled",
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) { BOOST_LOG_SEV(lg, level_info) << rec; }));
+    print_micro_row("boost", "BOOST_LOG_SEV(debug)", "severity filter",
+                    micro_ns_per_call(spec, work, [&](const log_record &rec) { BOOST_LOG_SEV(lg, level_debug) << rec; }));
+    print_micro_row("boost", "static_log<level_debug>(BOOST_LOG_SEV())", "template guard", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        static_log<level_debug>([&] { BOOST_LOG_SEV(lg, level_debug) << rec; });
+    }));
+
+    logging::core::get()->remove_sink(sink);
+    logging::core::get()->reset_filter();
+}
+
+// Message formatting alone, into a reused buffer or stream, as each library does it
+void run_format_micro(const micro_spec &spec, const workload &work) {
+    const std::string &pattern = work.format_pattern();
+    std::string boost_pattern;
+    for (int i = 0; i <= work.spec().nargs(); i++)
+        boost_pattern += (i ? " %" : "%") + std::to_string(i + 1) + "%";
+
+    fmt::memory_buffer buf;
+    print_micro_row("format", "fmt::format_to(memory_buffer)", "no sink", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        buf.clear();
+        with_record_args(rec, [&](fmt::string_view text, const auto &...args) { fmt::format_to(std::back_inserter(buf), fmt::runtime(pattern), text, args...); });
+        micro_keep(buf);
+    }));
+    std::ostringstream os;
+    print_micro_row("format", "std::ostream << record", "no sink", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        os.seekp(0);
+        os << rec;
+        micro_keep(os);
+    }));
+    print_micro_row("format", "boost::format(\"%1% %2%...\")", "no sink", micro_ns_per_call(spec, work, [&](const log_record &rec) {
+        boost::format f(boost_pattern);
+        f % boost::string_view(rec.text, rec.text_size);
+        for (int i = 0; i < rec.nargs; i++)
+            f % rec.args[i];
+        std::string out = f.str();
+        micro_keep(out);
+    }));
+    print_micro_row("-", "empty loop", "baseline", micro_ns_per_call(spec, work, [&](const log_record &rec) { micro_keep(rec); }));
+}
+
+void run_microbenchmarks(const micro_spec &spec, const workload &work) {
+    std::cout << "Median ns/call of " << spec.trials << " trials x " << spec.iterations << " calls" << std::endl;
+    std::cout << std::left << std::setw(8) << "library" << std::setw(46) << "call" << std::setw(22) << "filtered by" << std::right
+              << std::setw(10) << "ns/call" << std::endl;
+    run_spdlog_micro(spec, work);
+    run_glog_micro(spec, work);
+    run_boost_micro(spec, work);
+    run_format_micro(spec, work);
+}
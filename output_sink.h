@@ -0,0 +1,390 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ios>
+#include <ostream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+// Where a backend's formatted bytes end up. sink_native keeps each library's own file
+// output; the others replace it with one of the output_sink implementations below, the
+// same for every library, so front-end cost and I/O cost can be told apart.
+enum sink_kind { sink_native, sink_null, sink_buffered, sink_mmap, sink_direct };
+
+sink_kind parse_sink_kind(const std::string &name) {
+    if (name == "native")
+        return sink_native;
+    if (name == "null")
+        return sink_null;
+    if (name == "buffered")
+        return sink_buffered;
+    if (name == "mmap")
+        return sink_mmap;
+    if (name == "direct")
+        return sink_direct;
+    throw std::runtime_error("Unknown sink: " + name);
+}
+
+const char *sink_kind_name(sink_kind kind) {
+    switch (kind) {
+    case sink_null: return "null";
+    case sink_buffered: return "buffered";
+    case sink_mmap: return "mmap";
+    case sink_direct: return "direct";
+    default: return "native";
+    }
+}
+
+// Not thread-safe: callers serialise write() the way they would for their own file
+class output_sink {
+public:
+    virtual ~output_sink() {}
+    virtual void write(const char *data, size_t size) = 0;
+    virtual void flush() {}
+    // Flushes and releases the file, throwing on failure. The destructors do it too but
+    // swallow the error, since throwing there would std::terminate; teardown calls close()
+    virtual void close() {}
+    uint64_t bytes() const { return bytes_; }
+
+protected:
+    uint64_t bytes_ = 0;
+};
+
+// Counts and discards, leaving only the library's own cost
+class null_output_sink : public output_sink {
+public:
+    void write(const char *, size_t size) override { bytes_ += size; }
+};
+
+int open_output_file(const std::string &path, int access = O_WRONLY) {
+    int fd = open(path.c_str(), access | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open " + path);
+    return fd;
+}
+
+void write_fully(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0)
+            throw std::runtime_error("write() failed");
+        data += n;
+        size -= size_t(n);
+    }
+}
+
+// Plain write() behind a 64 KB user-space buffer
+class buffered_output_sink : public output_sink {
+public:
+    explicit buffered_output_sink(const std::string &path) : fd_(open_output_file(path)), buf_(new char[capacity]) {}
+    ~buffered_output_sink() override {
+        try {
+            close();
+        }
+        catch (const std::exception &) {
+        }
+    }
+
+    void write(const char *data, size_t size) override {
+        bytes_ += size;
+        if (used_ + size > capacity)
+            flush();
+        if (size >= capacity) {
+            write_fully(fd_, data, size);
+            return;
+        }
+        memcpy(buf_.get() + used_, data, size);
+        used_ += size;
+    }
+
+    void flush() override {
+        write_fully(fd_, buf_.get(), used_);
+        used_ = 0;
+    }
+
+    void close() override {
+        if (fd_ < 0)
+            return;
+        flush();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    static const size_t capacity = 64 * 1024;
+    int fd_;
+    std::unique_ptr<char[]> buf_;
+    size_t used_ = 0;
+};
+
+// Appends are memcpy()s into a preallocated, mapped file. The mapping doubles when it
+// fills up, and close() trims the file to what was written.
+class mmap_output_sink : public output_sink {
+public:
+    mmap_output_sink(const std::string &path, size_t size_hint) : fd_(open_output_file(path, O_RDWR)) {
+        map(std::max<size_t>(size_hint, 1 << 20));
+    }
+    ~mmap_output_sink() override {
+        try {
+            close();
+        }
+        catch (const std::exception &) {
+        }
+    }
+
+    void write(const char *data, size_t size) override {
+        if (bytes_ + size > mapped_)
+            map(std::max(mapped_ * 2, size_t(bytes_ + size)));
+        memcpy(base_ + bytes_, data, size);
+        bytes_ += size;
+    }
+
+    // Starts writeback without waiting for it, as a buffered file would
+    void flush() override { msync(base_, size_t(bytes_), MS_ASYNC); }
+
+    void close() override {
+        if (fd_ < 0)
+            return;
+        munmap(base_, mapped_);
+        base_ = nullptr;
+        bool trimmed = ftruncate(fd_, off_t(bytes_)) == 0;
+        ::close(fd_);
+        fd_ = -1;
+        if (!trimmed)
+            throw std::runtime_error("ftruncate() failed");
+    }
+
+private:
+    void map(size_t size) {
+        if (base_)
+            munmap(base_, mapped_);
+#if defined(__linux__)
+        // Reserve the blocks up front so page faults never have to allocate on disk
+        if (posix_fallocate(fd_, 0, off_t(size)) != 0 && ftruncate(fd_, off_t(size)) != 0)
+#else
+        if (ftruncate(fd_, off_t(size)) != 0)
+#endif
+            throw std::runtime_error("Failed to preallocate the mmap sink file");
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("mmap() failed");
+        base_ = static_cast<char *>(p);
+        mapped_ = size;
+    }
+
+    int fd_;
+    char *base_ = nullptr;
+    size_t mapped_ = 0;
+};
+
+// Durable output: 1 MB batches written around the page cache (O_DIRECT on Linux,
+// F_NOCACHE on macOS) and fdatasync()ed one by one. Falls back to cached writes plus
+// fdatasync where the filesystem refuses O_DIRECT, e.g. tmpfs.
+class direct_output_sink : public output_sink {
+public:
+    explicit direct_output_sink(const std::string &path) {
+#if defined(O_DIRECT)
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#endif
+        if (fd_ < 0)
+            fd_ = open_output_file(path);
+#if defined(F_NOCACHE)
+        fcntl(fd_, F_NOCACHE, 1);
+#endif
+        void *p = nullptr;
+        if (posix_memalign(&p, alignment, capacity) != 0)
+            throw std::runtime_error("posix_memalign() failed");
+        buf_.reset(static_cast<char *>(p));
+    }
+    ~direct_output_sink() override {
+        try {
+            close();
+        }
+        catch (const std::exception &) {
+        }
+    }
+
+    void write(const char *data, size_t size) override {
+        bytes_ += size;
+        while (size > 0) {
+            size_t n = std::min(size, capacity - used_);
+            memcpy(buf_.get() + used_, data, n);
+            used_ += n;
+            data += n;
+            size -= n;
+            if (used_ == capacity) {
+                write_block(capacity);
+                file_offset_ += capacity;
+                used_ = 0;
+            }
+        }
+    }
+
+    // Writes the partial batch padded to the block size, then trims the file. The batch
+    // stays buffered, so the next write rewrites that block with more data in it.
+    void flush() override {
+        if (used_ == 0)
+            return;
+        size_t padded = (used_ + alignment - 1) / alignment * alignment;
+        memset(buf_.get() + used_, 0, padded - used_);
+        write_block(padded);
+        if (ftruncate(fd_, off_t(file_offset_ + used_)) != 0)
+            throw std::runtime_error("ftruncate() failed");
+    }
+
+    void close() override {
+        if (fd_ < 0)
+            return;
+        flush();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    struct free_deleter {
+        void operator()(char *p) const { free(p); }
+    };
+
+    void write_block(size_t size) {
+        if (pwrite(fd_, buf_.get(), size, off_t(file_offset_)) != ssize_t(size))
+            throw std::runtime_error("pwrite() failed");
+#if defined(__APPLE__)
+        fcntl(fd_, F_FULLFSYNC);
+#else
+        fdatasync(fd_);
+#endif
+    }
+
+    static const size_t alignment = 4096;
+    static const size_t capacity = 1 << 20;
+    int fd_ = -1;
+    std::unique_ptr<char, free_deleter> buf_;
+    size_t used_ = 0;
+    uint64_t file_offset_ = 0;
+};
+
+// One unbuffered send per record into a local stream socket whose other end a thread
+// drains and discards: the extra sinks of the --fanout stress mode, standing in for a
+// socket or syslog appender next to the file
+class socket_output_sink : public output_sink {
+public:
+    socket_output_sink() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            throw std::runtime_error("socketpair() failed");
+        fd_ = fds[0];
+        peer_ = fds[1];
+        drain_ = std::thread([this] {
+            char buf[65536];
+            while (read(peer_, buf, sizeof(buf)) > 0) {
+            }
+        });
+    }
+    ~socket_output_sink() override { close(); }
+
+    void write(const char *data, size_t size) override {
+        bytes_ += size;
+        write_fully(fd_, data, size);
+    }
+
+    void close() override {
+        if (fd_ < 0)
+            return;
+        shutdown(fd_, SHUT_WR);
+        drain_.join();
+        ::close(fd_);
+        ::close(peer_);
+        fd_ = -1;
+    }
+
+private:
+    int fd_;
+    int peer_;
+    std::thread drain_;
+};
+
+// The file a backend using this sink writes, empty for the null sink
+std::string sink_output_path(sink_kind kind, const std::string &path) {
+    return kind == sink_null ? std::string() : path;
+}
+
+// Null for sink_native, which the backend handles itself
+std::unique_ptr<output_sink> make_output_sink(sink_kind kind, const std::string &path, size_t size_hint) {
+    switch (kind) {
+    case sink_null: return std::unique_ptr<output_sink>(new null_output_sink());
+    case sink_buffered: return std::unique_ptr<output_sink>(new buffered_output_sink(path));
+    case sink_mmap: return std::unique_ptr<output_sink>(new mmap_output_sink(path, size_hint));
+    case sink_direct: return std::unique_ptr<output_sink>(new direct_output_sink(path));
+    default: return nullptr;
+    }
+}
+
+// std::streambuf over an output_sink, for the libraries that write to a std::ostream.
+// Buffers like a filebuf and hands the sink whole chunks on sync(), so a stream flushed
+// after every record (Boost's auto_flush) costs one write per record, not one per piece.
+class output_sink_streambuf : public std::streambuf {
+public:
+    explicit output_sink_streambuf(output_sink *sink) : sink_(sink) { setp(buf_, buf_ + sizeof(buf_)); }
+
+protected:
+    int_type overflow(int_type ch) override {
+        write_out();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        write_out();
+        sink_->flush();
+        return 0;
+    }
+
+    // Only tellp() is supported
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (off == 0 && dir == std::ios_base::cur && (which & std::ios_base::out))
+            return pos_type(off_type(sink_->bytes()) + (pptr() - pbase()));
+        return pos_type(off_type(-1));
+    }
+
+private:
+    void write_out() {
+        if (pptr() > pbase())
+            sink_->write(pbase(), size_t(pptr() - pbase()));
+        setp(buf_, buf_ + sizeof(buf_));
+    }
+
+    output_sink *sink_;
+    char buf_[8192];
+};
+
+// std::ostream that owns its output_sink
+class output_sink_ostream : public std::ostream {
+public:
+    explicit output_sink_ostream(std::unique_ptr<output_sink> out) : std::ostream(nullptr), out_(std::move(out)), buf_(out_.get()) {
+        rdbuf(&buf_);
+    }
+
+    void close() {
+        flush();
+        out_->close();
+    }
+
+private:
+    std::unique_ptr<output_sink> out_;
+    output_sink_streambuf buf_;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Per-thread CPU counters for --perf. Each event is opened on its own with perf_event_open
+// so that a missing PMU (common in VMs) still leaves the software events; whatever cannot
+// be opened is reported as n/a and getrusage supplies CPU time and context switches.
+enum cpu_event {
+    event_cycles,
+    event_instructions,
+    event_llc_misses,
+    event_branch_misses,
+    event_context_switches,
+    event_futex_calls,    // syscalls:sys_enter_futex, needs tracefs access
+    cpu_event_count
+};
+
+const char *cpu_event_name(int event) {
+    static const char *names[cpu_event_count] = {"cycles", "instructions", "LLC misses", "branch misses", "context switches", "futex calls"};
+    return names[event];
+}
+
+struct cpu_counters {
+    uint64_t value[cpu_event_count] = {};
+    bool valid[cpu_event_count] = {};
+    // Kernel-mode counting was not permitted, so time spent in write() etc. is missing
+    bool user_only = false;
+
+    bool has_usage = false;
+    double cpu_secs = 0;
+    // Voluntary switches are mostly blocking on a futex or on I/O
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+
+    void add(const cpu_counters &other) {
+        for (int i = 0; i < cpu_event_count; i++) {
+            value[i] += other.value[i];
+            valid[i] = valid[i] || other.valid[i];
+        }
+        user_only = user_only || other.user_only;
+        if (other.has_usage) {
+            has_usage = true;
+            cpu_secs += other.cpu_secs;
+            voluntary_switches += other.voluntary_switches;
+            involuntary_switches += other.involuntary_switches;
+        }
+    }
+};
+
+#if defined(__linux__)
+// Tracepoint id of syscalls:sys_enter_futex, -1 if tracefs is not readable
+long futex_tracepoint_id() {
+    static long id = [] {
+        for (const char *path : {"/sys/kernel/tracing/events/syscalls/sys_enter_futex/id",
+                                 "/sys/kernel/debug/tracing/events/syscalls/sys_enter_futex/id"}) {
+            FILE *f = fopen(path, "r");
+            if (!f)
+                continue;
+            long value = -1;
+            if (fscanf(f, "%ld", &value) != 1)
+                value = -1;
+            fclose(f);
+            if (value >= 0)
+                return value;
+        }
+        return -1L;
+    }();
+    return id;
+}
+#endif
+
+// The events of one thread, counted from start() to stop()
+class perf_group {
+public:
+    // tid 0 is the calling thread
+    explicit perf_group(int tid = 0) {
+        for (int i = 0; i < cpu_event_count; i++)
+            fds_[i] = open_event(i, tid);
+    }
+
+    ~perf_group() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    perf_group(const perf_group &) = delete;
+    perf_group &operator=(const perf_group &) = delete;
+
+    void start() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    void stop() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // Adds the counts into c, scaled up if the kernel had to multiplex the PMU
+    void read_into(cpu_counters &c) const {
+#if defined(__linux__)
+        for (int i = 0; i < cpu_event_count; i++) {
+            uint64_t data[3];    // value, time enabled, time running
+            if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            uint64_t value = data[0];
+            if (data[2] > 0 && data[2] < data[1])
+                value = uint64_t(double(value) * double(data[1]) / double(data[2]));
+            c.value[i] += value;
+            c.valid[i] = true;
+        }
+        c.user_only = c.user_only || user_only_;
+#endif
+    }
+
+private:
+    int open_event(int event, int tid) {
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (event) {
+        case event_cycles: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case event_instructions: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case event_llc_misses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case event_branch_misses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case event_context_switches: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES; break;
+        case event_futex_calls:
+            if (futex_tracepoint_id() < 0)
+                return -1;
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.config = uint64_t(futex_tracepoint_id());
+            break;
+        }
+        int fd = int(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+        if (fd < 0 && attr.type == PERF_TYPE_HARDWARE) {
+            // perf_event_paranoid 2 still allows user-space counting of our own threads
+            attr.exclude_kernel = 1;
+            fd = int(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+            if (fd >= 0)
+                user_only_ = true;
+        }
+        return fd;
+#else
+        return -1;
+#endif
+    }
+
+    int fds_[cpu_event_count];
+    bool user_only_ = false;
+};
+
+// getrusage() of the calling thread where the OS has per-thread usage, false otherwise
+bool thread_rusage(struct rusage &usage) {
+#if defined(RUSAGE_THREAD)
+    return getrusage(RUSAGE_THREAD, &usage) == 0;
+#else
+    return false;
+#endif
+}
+
+void add_rusage_delta(cpu_counters &c, const struct rusage &before, const struct rusage &after) {
+    auto secs = [](const struct timeval &tv) { return double(tv.tv_sec) + double(tv.tv_usec) / 1e6; };
+    c.has_usage = true;
+    c.cpu_secs += secs(after.ru_utime) - secs(before.ru_utime) + secs(after.ru_stime) - secs(before.ru_stime);
+    c.voluntary_switches += uint64_t(after.ru_nvcsw - before.ru_nvcsw);
+    c.involuntary_switches += uint64_t(after.ru_nivcsw - before.ru_nivcsw);
+}
+
+// Counts the calling producer thread
+class thread_counters {
+public:
+    // Opens the counters on the calling thread. Separate from start() so the
+    // perf_event_open() calls stay out of the measured interval, and an unused
+    // thread_counters costs nothing.
+    void open() { group_.reset(new perf_group()); }
+
+    // Resets and enables the counters opened by open()
+    void start() {
+        has_usage_ = thread_rusage(usage_);
+        group_->start();
+    }
+
+    cpu_counters stop() {
+        group_->stop();
+        cpu_counters c;
+        group_->read_into(c);
+        struct rusage usage;
+        if (has_usage_ && thread_rusage(usage))
+            add_rusage_delta(c, usage_, usage);
+        return c;
+    }
+
+private:
+    std::unique_ptr<perf_group> group_;
+    struct rusage usage_;
+    bool has_usage_ = false;
+};
+
+// Counts every thread that already exists when it starts: the driver, the e2e reader and
+// the backend's own workers. Producers started later are added from their thread_counters.
+class process_counters {
+public:
+    void start() {
+#if defined(__linux__)
+        if (DIR *dir = opendir("/proc/self/task")) {
+            while (struct dirent *entry = readdir(dir))
+                if (entry->d_name[0] != '.')
+                    groups_.emplace_back(new perf_group(atoi(entry->d_name)));
+            closedir(dir);
+        }
+#endif
+        for (auto &group : groups_)
+            group->start();
+        getrusage(RUSAGE_SELF, &usage_);
+    }
+
+    // Whole-process totals; rusage covers the threads that have exited too
+    cpu_counters stop(const std::vector<cpu_counters> &producers) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        cpu_counters c;
+        for (auto &group : groups_) {
+            group->stop();
+            group->read_into(c);
+        }
+        for (auto p : producers) {
+            p.has_usage = false;    // already part of RUSAGE_SELF
+            c.add(p);
+        }
+        add_rusage_delta(c, usage_, usage);
+        return c;
+    }
+
+private:
+    std::vector<std::unique_ptr<perf_group>> groups_;
+    struct rusage usage_;
+};
+
+// One line of per-record figures, e.g. "CPU [spdlog_async thread 0]: IPC 1.9, 3.1 LLC misses/record, ..."
+void print_cpu_counters(const std::string &name, const cpu_counters &c, uint64_t records) {
+    double per = records ? 1.0 / double(records) : 0;
+    std::cout << "CPU [" << name << "]: ";
+    if (c.valid[event_cycles] && c.valid[event_instructions] && c.value[event_cycles])
+        std::cout << "IPC " << double(c.value[event_instructions]) / double(c.value[event_cycles]) << ", "
+                  << double(c.value[event_cycles]) * per << " cycles/record, ";
+    else
+        std::cout << "IPC n/a, ";
+    for (int i = event_llc_misses; i < cpu_event_count; i++) {
+        if (c.valid[i])
+            std::cout << double(c.value[i]) * per << " " << cpu_event_name(i) << "/record, ";
+        else if (i != event_futex_calls)
+            std::cout << cpu_event_name(i) << " n/a, ";
+    }
+    if (c.has_usage)
+        std::cout << double(c.voluntary_switches) * per << " voluntary switches/record, "
+                  << double(c.involuntary_switches) * per << " involuntary switches/record, " << c.cpu_secs << " CPU secs";
+    else
+        std::cout << "rusage n/a";
+    std::cout << (c.user_only ? " (user mode only)" : "") << std::endl;
+}
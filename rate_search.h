@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench_driver.h"
+
+// --find-max-rate: open-loop runs at increasing rates until p99 exceeds the limit
+struct rate_search_spec {
+    bool enabled = false;
+    double start_rate = 10000;
+    double p99_limit_us = 1000;
+    // Each step logs about this many seconds' worth of records (capped by the workload size)
+    double step_secs = 1;
+    // Bisection steps between the last good and the first degraded rate
+    int refine_steps = 4;
+};
+
+// Applies a --find-max-rate / --start-rate / --p99-limit-us / --step-secs option; false if arg is not one
+bool parse_rate_search_option(const std::string &arg, rate_search_spec &spec) {
+    if (arg == "--find-max-rate")
+        spec.enabled = true;
+    else if (arg.rfind("--start-rate=", 0) == 0) {
+        spec.start_rate = atof(arg.c_str() + 13);
+        if (!(spec.start_rate > 0))
+            throw std::runtime_error("--start-rate must be a positive number of records/sec");
+    }
+    else if (arg.rfind("--p99-limit-us=", 0) == 0) {
+        spec.p99_limit_us = atof(arg.c_str() + 15);
+        if (!(spec.p99_limit_us > 0))
+            throw std::runtime_error("--p99-limit-us must be a positive number of microseconds");
+    }
+    else if (arg.rfind("--step-secs=", 0) == 0) {
+        spec.step_secs = atof(arg.c_str() + 12);
+        if (!(spec.step_secs > 0))
+            throw std::runtime_error("--step-secs must be a positive number of seconds");
+    }
+    else
+        return false;
+    return true;
+}
+
+// One open-loop run at the given total rate; true if p99 stayed within the limit
+bool run_at_rate(const backend_entry &entry, const rate_search_spec &search, bench_config config, arrival_spec arrival, double rate) {
+    arrival.rate = rate;
+    config.arrival = &arrival;
+    config.howmany = int(std::min<double>(config.work->size(), std::max<double>(rate * search.step_secs, config.thread_count)));
+
+    auto backend = entry.create();
+    bench_result r = run_backend(*backend, config);
+    double p99_us = double(r.latency.percentile(0.99)) * latency_ns_per_tick / 1000;
+    bool ok = p99_us <= search.p99_limit_us;
+
+    std::cout << r.name << "\ttarget " << uint64_t(rate) << " records/sec\tachieved " << uint64_t(r.records / r.elapsed_secs)
+              << "\tp99 " << p99_us << "us\t" << (ok ? "ok" : "degraded") << std::endl;
+    return ok;
+}
+
+// Finds, per backend, the highest open-loop rate whose p99 (measured from the intended
+// send time) stays under the limit: doubling first, then bisecting.
+void find_max_rates(const rate_search_spec &search, const std::vector<std::string> &names, const bench_config &config,
+                    arrival_spec arrival) {
+    // A trace fixes its own send times, so there is no rate to search over
+    if (arrival.kind == arrival_trace)
+        throw std::runtime_error("--find-max-rate takes --arrival=constant or poisson, not a trace");
+    if (arrival.kind != arrival_poisson)
+        arrival.kind = arrival_constant;
+
+    for (auto *entry : select_backends(names)) {
+        double good = 0, bad = 0;
+        for (double rate = search.start_rate; rate < 1e10; rate *= 2) {
+            if (!run_at_rate(*entry, search, config, arrival, rate)) {
+                bad = rate;
+                break;
+            }
+            good = rate;
+        }
+        for (int i = 0; i < search.refine_steps && good > 0 && bad > 0; i++) {
+            double mid = std::sqrt(good * bad);
+            if (run_at_rate(*entry, search, config, arrival, mid))
+                good = mid;
+            else
+                bad = mid;
+        }
+
+        std::cout << "Max sustainable rate [" << entry->name << "] (" << arrival_kind_name(arrival.kind) << ", p99 <= "
+                  << search.p99_limit_us << "us): ";
+        if (good > 0)
+            std::cout << uint64_t(good) << " records/sec" << std::endl << std::endl;
+        else
+            std::cout << "below " << uint64_t(search.start_rate) << " records/sec" << std::endl << std::endl;
+    }
+}
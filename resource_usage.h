@@ -0,0 +1,46 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Resets the kernel's peak-RSS watermark so that the next peak_rss_kb() covers only what
+// happens from here on. Linux only; returns false where the peak is process-lifetime.
+bool reset_peak_rss() {
+#if defined(__linux__)
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+        return false;
+    bool ok = fputs("5", f) >= 0;
+    return fclose(f) == 0 && ok;
+#else
+    return false;
+#endif
+}
+
+// Peak resident set size in KB
+long peak_rss_kb() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f))
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kb = atol(line + 6);
+                break;
+            }
+        fclose(f);
+        if (kb >= 0)
+            return kb;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;    // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
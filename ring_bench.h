@@ -0,0 +1,380 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "bench_backend.h"
+#include "latency_histogram.h"
+
+// In-tree reference logger: roughly the floor an async logger can reach on this machine.
+// Each producer owns a single-producer/single-consumer byte ring and copies the raw
+// record into it (TSC timestamp, text, binary args); one consumer thread formats the
+// records and writes each batch with one writev().
+
+inline uint64_t ring_clock_now() {
+#ifdef LATENCY_HAS_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Variable-length entries, 8-byte aligned. An entry that would straddle the end of the
+// buffer is preceded by a padding entry that fills the rest of it.
+class spsc_ring {
+public:
+    struct entry_header {
+        uint32_t size;     // whole entry including alignment padding
+        uint16_t level;    // padding_level for the filler at the end of the buffer
+        uint16_t nargs;
+        uint64_t timestamp;
+        uint32_t text_size;
+        uint32_t reserved;
+    };
+    static const uint16_t padding_level = 0xffff;
+
+    explicit spsc_ring(size_t capacity) : buf_(capacity), mask_(capacity - 1) {}
+
+    // Before C++17, plain new ignores the cache-line alignment of the members below
+    static void *operator new(size_t size) {
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, size) != 0)
+            throw std::bad_alloc();
+        return p;
+    }
+    static void operator delete(void *p) { free(p); }
+
+    // Producer: space for an entry of `size` bytes, or nullptr if the ring is full
+    char *try_reserve(uint32_t size) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t offset = head & mask_;
+        uint64_t pad = offset + size > buf_.size() ? buf_.size() - offset : 0;
+        if (head + pad + size - cached_tail_ > buf_.size()) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head + pad + size - cached_tail_ > buf_.size())
+                return nullptr;
+        }
+        if (pad) {
+            entry_header filler = {uint32_t(pad), padding_level, 0, 0, 0, 0};
+            memcpy(&buf_[offset], &filler, sizeof(uint64_t));    // size and level are enough
+            // Release, like commit(): the consumer must see the filler before the new head
+            head_.store(head + pad, std::memory_order_release);
+            offset = 0;
+        }
+        return &buf_[offset];
+    }
+
+    // Producer: publishes the entry returned by the last try_reserve()
+    void commit(uint32_t size) { head_.store(head_.load(std::memory_order_relaxed) + size, std::memory_order_release); }
+
+    // Consumer side
+    uint64_t head() const { return head_.load(std::memory_order_acquire); }
+    uint64_t tail() const { return tail_.load(std::memory_order_relaxed); }
+    const char *at(uint64_t pos) const { return &buf_[pos & mask_]; }
+    void release(uint64_t tail) { tail_.store(tail, std::memory_order_release); }
+
+    long thread_id() const { return thread_id_; }
+    // Set by the producer that claims the ring, before its first commit()
+    void set_thread_id(long thread_id) { thread_id_ = thread_id; }
+
+private:
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t cached_tail_ = 0;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::vector<char> buf_;
+    uint64_t mask_;
+    long thread_id_ = 0;
+};
+
+class ring_async_backend : public logger_backend {
+public:
+    const char *name() const override { return "ring_async"; }
+    const char *title() const override { return "Ring Buffer: Async Log (reference)"; }
+    int64_t bytes_written() const override { return int64_t(bytes_.load()); }
+    int64_t records_written() const override { return int64_t(records_.load()); }
+    std::string output_path() const override { return path_; }
+    bool is_async() const override { return true; }
+
+    void setup(const bench_config &config) override {
+        // queue_size is in records for the other backends; give each producer its share at
+        // 64 bytes a record, and always room for a few of the largest records
+        size_t per_thread = size_t(std::max(config.queue_size / std::max(config.thread_count, 1), 1)) * 64;
+        size_t min_size = size_t(config.work->spec().max_size + 64 * 8) * 4;
+        ring_capacity_ = 4096;
+        while (ring_capacity_ < std::max(per_thread, min_size))
+            ring_capacity_ *= 2;
+        block_ = config.overflow != overflow_drop;
+
+        path_ = sink_output_path(config.sink, config.log_dir + "/ring_async_log.txt");
+        out_ = make_backend_sink(config, config.log_dir + "/ring_async_log.txt");
+        if (!out_)
+            fd_ = open_output_file(path_);
+
+        // TSC to wall clock, so the producers only ever read the TSC
+        auto wall_start = std::chrono::system_clock::now();
+        uint64_t ticks_start = ring_clock_now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t ticks_end = ring_clock_now();
+        auto wall_end = std::chrono::system_clock::now();
+        ns_per_tick_ = double(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_end - wall_start).count()) / double(ticks_end - ticks_start);
+        wall_base_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(wall_start.time_since_epoch()).count();
+        ticks_base_ = ticks_start;
+
+        // One ring per producer, allocated and zero-filled here so that neither the
+        // allocation nor its page faults land in the producers' measured interval
+        for (int t = 0; t < config.thread_count; t++)
+            rings_.emplace_back(new spsc_ring(ring_capacity_));
+        next_ring_ = 0;
+
+        consumer_ = std::thread(&ring_async_backend::consume, this);
+    }
+
+    // Claims one of the rings setup() allocated
+    void thread_begin() override {
+#if defined(__linux__)
+        long tid = long(syscall(SYS_gettid));
+#else
+        long tid = long(std::hash<std::thread::id>()(std::this_thread::get_id()) % 1000000);
+#endif
+        size_t index = next_ring_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= rings_.size())
+            throw std::runtime_error("ring_async: more producers than rings");
+        rings_[index]->set_thread_id(tid);
+        current_ring() = rings_[index].get();
+    }
+
+    void thread_end() override { current_ring() = nullptr; }
+
+    void log_one(const log_record &rec) override {
+        if (rec.level < log_threshold)
+            return;
+        uint64_t timestamp = ring_clock_now();
+
+        uint32_t size = uint32_t(sizeof(spsc_ring::entry_header)) + rec.text_size;
+        for (int i = 0; i < rec.nargs; i++)
+            size += rec.args[i].kind == bench_arg::string ? 1 + 4 + rec.args[i].s.size : 1 + 8;
+        size = (size + 7) & ~7u;
+
+        spsc_ring *ring = current_ring();
+        char *p;
+        while (!(p = ring->try_reserve(size))) {
+            if (!block_)
+                return;    // overflow_drop: shows up as dropped, since the consumer never counts it
+            std::this_thread::yield();
+        }
+
+        spsc_ring::entry_header header = {size, uint16_t(rec.level), uint16_t(rec.nargs), timestamp, rec.text_size, 0};
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        memcpy(p, rec.text, rec.text_size);
+        p += rec.text_size;
+        for (int i = 0; i < rec.nargs; i++) {
+            const bench_arg &arg = rec.args[i];
+            *p++ = char(arg.kind);
+            if (arg.kind == bench_arg::string) {
+                memcpy(p, &arg.s.size, 4);
+                memcpy(p + 4, arg.s.data, arg.s.size);
+                p += 4 + arg.s.size;
+            }
+            else {
+                memcpy(p, &arg.i, 8);    // int64 and double share the bytes
+                p += 8;
+            }
+        }
+        ring->commit(size);
+    }
+
+    // Waits until everything logged so far is in the file
+    void flush() override {
+        uint64_t target = 0;
+        for (auto &ring : rings_)
+            target += ring->head();
+        while (committed_.load(std::memory_order_acquire) < target)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    void teardown() override {
+        stop_.store(true, std::memory_order_release);
+        consumer_.join();
+        if (out_)
+            out_->close();
+        else
+            close(fd_);
+        rings_.clear();
+    }
+
+private:
+    static spsc_ring *&current_ring() {
+        static thread_local spsc_ring *ring = nullptr;
+        return ring;
+    }
+
+    void consume() {
+        // The rings are all in place before this thread starts
+        std::vector<spsc_ring *> rings;
+        for (auto &ring : rings_)
+            rings.push_back(ring.get());
+        std::vector<fmt::memory_buffer> out(rings.size());
+        std::vector<struct iovec> iov;
+        int idle = 0;
+
+        for (;;) {
+            bool stopping = stop_.load(std::memory_order_acquire);
+
+            // Format a bounded batch from every ring, hand the space back, then write it all at once
+            uint64_t consumed = 0, records = 0;
+            iov.clear();
+            for (size_t r = 0; r < rings.size(); r++) {
+                spsc_ring &ring = *rings[r];
+                out[r].clear();
+                uint64_t pos = ring.tail(), end = ring.head();
+                while (pos < end && out[r].size() < 256 * 1024) {
+                    spsc_ring::entry_header header;
+                    memcpy(&header, ring.at(pos), sizeof(uint64_t));
+                    if (header.level != spsc_ring::padding_level) {
+                        memcpy(&header, ring.at(pos), sizeof(header));
+                        format_entry(out[r], header, ring.at(pos) + sizeof(header), ring.thread_id());
+                        records++;
+                    }
+                    pos += header.size;
+                }
+                consumed += pos - ring.tail();
+                ring.release(pos);
+                if (out[r].size() > 0)
+                    iov.push_back({out[r].data(), out[r].size()});
+            }
+
+            write_all(iov);
+            records_.fetch_add(records, std::memory_order_relaxed);
+            committed_.fetch_add(consumed, std::memory_order_release);
+
+            if (consumed > 0) {
+                idle = 0;
+                continue;
+            }
+            if (stopping)
+                break;
+            if (++idle < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    // Same layout as the spdlog backends' "[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v"
+    void format_entry(fmt::memory_buffer &out, const spsc_ring::entry_header &header, const char *p, long thread_id) {
+        static const char *levels[] = {"debug", "info", "warning", "error"};
+        int64_t ns = wall_base_ns_ + int64_t(double(header.timestamp - ticks_base_) * ns_per_tick_);
+        time_t secs = time_t(ns / 1000000000);
+        if (secs != cached_secs_) {
+            struct tm tm;
+            localtime_r(&secs, &tm);
+            cached_secs_ = secs;
+            cached_date_len_ = strftime(cached_date_, sizeof(cached_date_), "%Y-%m-%d %H:%M:%S", &tm);
+        }
+        out.push_back('[');
+        out.append(cached_date_, cached_date_ + cached_date_len_);
+        fmt::format_to(std::back_inserter(out), ".{:03}] [{}] <{}>  ", (ns / 1000000) % 1000, levels[header.level], thread_id);
+        out.append(p, p + header.text_size);
+        p += header.text_size;
+        for (int i = 0; i < header.nargs; i++) {
+            char kind = *p++;
+            if (kind == bench_arg::string) {
+                uint32_t len;
+                memcpy(&len, p, 4);
+                out.push_back(' ');
+                out.append(p + 4, p + 4 + len);
+                p += 4 + len;
+            }
+            else if (kind == bench_arg::integer) {
+                int64_t value;
+                memcpy(&value, p, 8);
+                fmt::format_to(std::back_inserter(out), " {}", value);
+                p += 8;
+            }
+            else {
+                double value;
+                memcpy(&value, p, 8);
+                fmt::format_to(std::back_inserter(out), " {:g}", value);    // as bench_arg's formatter
+                p += 8;
+            }
+        }
+        out.push_back('\n');
+    }
+
+    void write_all(std::vector<struct iovec> &iov) {
+        if (out_) {
+            for (auto &v : iov) {
+                out_->write(static_cast<const char *>(v.iov_base), v.iov_len);
+                bytes_.fetch_add(v.iov_len, std::memory_order_relaxed);
+            }
+            return;
+        }
+        size_t first = 0;
+        while (first < iov.size()) {
+            int count = int(std::min<size_t>(iov.size() - first, IOV_MAX));
+            ssize_t n = writev(fd_, &iov[first], count);
+            if (n < 0)
+                throw std::runtime_error("writev() failed on " + path_);
+            bytes_.fetch_add(uint64_t(n), std::memory_order_relaxed);
+            // Skip what was written, including a partially written iovec
+            while (n > 0 && first < iov.size()) {
+                if (size_t(n) >= iov[first].iov_len) {
+                    n -= ssize_t(iov[first].iov_len);
+                    first++;
+                }
+                else {
+                    iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + n;
+                    iov[first].iov_len -= size_t(n);
+                    n = 0;
+                }
+            }
+        }
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    std::unique_ptr<output_sink> out_;    // replaces fd_ for every sink but sink_native
+    size_t ring_capacity_ = 0;
+    bool block_ = true;
+
+    double ns_per_tick_ = 1;
+    int64_t wall_base_ns_ = 0;
+    uint64_t ticks_base_ = 0;
+    time_t cached_secs_ = -1;
+    char cached_date_[32];
+    size_t cached_date_len_ = 0;
+
+    std::vector<std::unique_ptr<spsc_ring>> rings_;
+    std::atomic<size_t> next_ring_{0};
+    std::thread consumer_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> committed_{0};    // ring bytes whose records have been written
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> records_{0};
+};
+
+REGISTER_LOGGER_BACKEND(ring_async_backend)
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+
+// --rotate / --fanout stress mode: the library rotates its log file by size and every
+// record also goes to extra socket sinks. The backends report each rotation here from
+// their libraries' file hooks, and the driver lines them up with the producers' slow calls.
+class rotation_events {
+public:
+    // A log file was opened; every open but the first is a rotation
+    void file_opened() {
+        uint64_t now = latency_now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (opens_++ > 0)
+            ticks_.push_back(now);
+    }
+
+    // A log file was closed at this size, so rotated files still add up to the bytes written
+    void file_closed(uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_ += bytes;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        opens_ = 0;
+        bytes_ = 0;
+        ticks_.clear();
+    }
+
+    std::vector<uint64_t> ticks() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ticks_;
+    }
+
+    uint64_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    int opens_ = 0;
+    uint64_t bytes_ = 0;
+    std::vector<uint64_t> ticks_;
+};
+
+rotation_events rotation_log;
+
+// Slow calls starting this close to a rotation are attributed to it
+double rotation_window_us = 1000;
+
+// Rotated files a library keeps where it takes a limit (spdlog renames all of them on
+// every rotation); glog and Boost.Log keep every file
+const int rotation_max_files = 4;
+
+// Slow calls each producer keeps for the rotation report
+const size_t rotation_max_spikes = 100000;
+
+// "4096", "64K", "1M" or "1G" in bytes
+int64_t parse_byte_size(const std::string &text) {
+    char *end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    switch (*end) {
+    case 'k': case 'K': value *= 1024; break;
+    case 'm': case 'M': value *= 1024 * 1024; break;
+    case 'g': case 'G': value *= 1024 * 1024 * 1024; break;
+    case '\0': break;
+    default: throw std::runtime_error("Bad size: " + text);
+    }
+    if (value <= 0)
+        throw std::runtime_error("Bad size: " + text);
+    return int64_t(value);
+}
+
+struct rotation_spike_stats {
+    uint64_t offset_ticks = 0;    // since the start of the run
+    size_t slow_calls = 0;
+    uint64_t worst_ticks = 0;
+};
+
+// Rotations during the run and the sampled calls slower than the stall threshold around them
+struct rotation_report {
+    std::vector<rotation_spike_stats> rotations;
+    size_t slow_calls = 0;
+    size_t near_calls = 0;
+    uint64_t worst_near_ticks = 0;
+    uint64_t worst_elsewhere_ticks = 0;
+};
+
+// Attributes every spike to the nearest rotation within rotation_window_us, if any
+rotation_report correlate_rotations(const std::vector<uint64_t> &rotation_ticks, std::vector<latency_spike> spikes, uint64_t start_ticks) {
+    rotation_report report;
+    std::vector<uint64_t> ticks;
+    for (uint64_t t : rotation_ticks)
+        if (t >= start_ticks)
+            ticks.push_back(t);
+    std::sort(ticks.begin(), ticks.end());
+    for (uint64_t t : ticks) {
+        rotation_spike_stats r;
+        r.offset_ticks = t - start_ticks;
+        report.rotations.push_back(r);
+    }
+
+    uint64_t window = uint64_t(rotation_window_us * 1000 / latency_ns_per_tick);
+    report.slow_calls = spikes.size();
+    for (auto &spike : spikes) {
+        // The nearest rotation on either side of the call's start
+        auto next = std::lower_bound(ticks.begin(), ticks.end(), spike.start);
+        size_t best = ticks.size();
+        uint64_t best_distance = window + 1;
+        if (next != ticks.end() && *next - spike.start < best_distance) {
+            best = size_t(next - ticks.begin());
+            best_distance = *next - spike.start;
+        }
+        if (next != ticks.begin() && spike.start - *(next - 1) < best_distance)
+            best = size_t(next - 1 - ticks.begin());
+
+        if (best == ticks.size()) {
+            report.worst_elsewhere_ticks = std::max(report.worst_elsewhere_ticks, spike.ticks);
+            continue;
+        }
+        report.near_calls++;
+        report.worst_near_ticks = std::max(report.worst_near_ticks, spike.ticks);
+        report.rotations[best].slow_calls++;
+        report.rotations[best].worst_ticks = std::max(report.rotations[best].worst_ticks, spike.ticks);
+    }
+    return report;
+}
+
+// Prints the summary and the first max_lines rotations
+void print_rotation_report(const rotation_report &report, int64_t rotate_bytes, int fanout, double stall_us, size_t max_lines = 20) {
+    auto us = [](uint64_t ticks) { return double(ticks) * latency_ns_per_tick / 1000; };
+    std::streamsize precision = std::cout.precision();
+    std::cout << "Rotation: " << report.rotations.size() << " rotations at " << rotate_bytes << " bytes, " << fanout << " sink(s) per logger\t"
+              << report.slow_calls << " sampled calls > " << stall_us << "us, " << report.near_calls << " within " << rotation_window_us
+              << "us of a rotation" << std::fixed << std::setprecision(1) << " (worst " << us(report.worst_near_ticks)
+              << "us), worst elsewhere " << us(report.worst_elsewhere_ticks) << "us" << std::endl;
+    for (size_t i = 0; i < report.rotations.size() && i < max_lines; i++) {
+        const rotation_spike_stats &r = report.rotations[i];
+        std::cout << "  rotation " << std::setw(4) << i + 1 << " at " << std::setw(10) << us(r.offset_ticks) / 1000 << "ms: " << std::setw(6)
+                  << r.slow_calls << " slow calls, worst " << us(r.worst_ticks) << "us" << std::endl;
+    }
+    if (report.rotations.size() > max_lines)
+        std::cout << "  ... " << report.rotations.size() - max_lines << " more" << std::endl;
+    std::cout << std::defaultfloat << std::setprecision(int(precision));
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+#include "bench_driver.h"
+
+// --repeat: every backend runs warmup + N times, each time in a fresh child process
+// (fork/exec of this binary), so no library state, sink registration or heap layout
+// carries over from the previous run. The parent only collects and summarises.
+enum settle_mode { settle_none, settle_sync, settle_drop_caches };
+
+struct repeat_spec {
+    int repetitions = 0;    // 0 runs every backend once, in process
+    int warmup = 1;
+    settle_mode between = settle_none;
+    std::string json_path;
+    std::string csv_path;
+    // Set in the children: where to write the result
+    int report_fd = -1;
+};
+
+// Applies a --repeat / --warmup / --between / --json / --csv / --report-fd option; false if arg is not one
+bool parse_repeat_option(const std::string &arg, repeat_spec &spec) {
+    if (arg.rfind("--repeat=", 0) == 0)
+        spec.repetitions = atoi(arg.c_str() + 9);
+    else if (arg.rfind("--warmup=", 0) == 0)
+        spec.warmup = atoi(arg.c_str() + 9);
+    else if (arg == "--between=none")
+        spec.between = settle_none;
+    else if (arg == "--between=sync")
+        spec.between = settle_sync;
+    else if (arg == "--between=drop-caches")
+        spec.between = settle_drop_caches;
+    else if (arg.rfind("--json=", 0) == 0)
+        spec.json_path = arg.substr(7);
+    else if (arg.rfind("--csv=", 0) == 0)
+        spec.csv_path = arg.substr(6);
+    else if (arg.rfind("--report-fd=", 0) == 0)
+        spec.report_fd = atoi(arg.c_str() + 12);
+    else
+        return false;
+    return true;
+}
+
+// The figures a child reports for one run, in a fixed order
+std::vector<std::pair<std::string, double>> run_metrics(const bench_result &r) {
+    auto ns = [](uint64_t ticks) { return double(ticks) * latency_ns_per_tick; };
+    std::vector<std::pair<std::string, double>> metrics = {
+        {"records_per_sec", r.records / r.elapsed_secs},
+        {"records_per_sec_drained", r.records / (r.elapsed_secs + r.drain_secs)},
+        {"mb_per_sec", double(r.bytes_written) / (r.elapsed_secs + r.drain_secs) / 1024 / 1024},
+        {"p50_ns", ns(r.latency.percentile(0.5))},
+        {"p99_ns", ns(r.latency.percentile(0.99))},
+        {"p999_ns", ns(r.latency.percentile(0.999))},
+        {"max_ns", ns(r.latency.max())},
+        {"stall_secs", r.stall_secs},
+        {"peak_rss_kb", double(r.peak_rss_kb)},
+    };
+    if (r.dropped >= 0)
+        metrics.push_back({"dropped", double(r.dropped)});
+    if (r.has_alloc)
+        metrics.push_back({"allocs_per_record", r.records ? double(r.hot_alloc.allocations) / r.records : 0});
+    if (r.has_rotation) {
+        metrics.push_back({"rotations", double(r.rotation.rotations.size())});
+        metrics.push_back({"slow_calls_near_rotation", double(r.rotation.near_calls)});
+        metrics.push_back({"worst_near_rotation_ns", double(r.rotation.worst_near_ticks) * latency_ns_per_tick});
+    }
+    return metrics;
+}
+
+// Child side: one run of one backend, reported as "metric value" lines on report_fd
+void run_reporting_child(const std::vector<std::string> &names, const bench_config &config, int report_fd) {
+    std::vector<const backend_entry *> selected = select_backends(names);
+    if (selected.size() != 1)
+        throw std::runtime_error("--report-fd needs exactly one backend");
+    auto backend = selected[0]->create();
+    bench_result result = run_backend(*backend, config);
+
+    std::ostringstream out;
+    out << std::setprecision(17);
+    for (auto &metric : run_metrics(result))
+        out << metric.first << " " << metric.second << "\n";
+    std::string text = out.str();
+    if (write(report_fd, text.data(), text.size()) != ssize_t(text.size()))
+        throw std::runtime_error("Failed to write the run report");
+    close(report_fd);
+}
+
+std::string self_executable(const char *argv0) {
+#if defined(__linux__)
+    char path[4096];
+    ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n > 0)
+        return std::string(path, size_t(n));
+#elif defined(__APPLE__)
+    char path[4096];
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) == 0)
+        return path;
+#endif
+    return argv0;
+}
+
+// Flushes dirty pages and, if permitted, empties the page cache so no run starts warm
+void settle_between_runs(settle_mode mode) {
+    if (mode == settle_none)
+        return;
+    sync();
+    if (mode == settle_drop_caches) {
+        FILE *f = fopen("/proc/sys/vm/drop_caches", "w");
+        if (!f || fputs("3", f) < 0) {
+            static bool warned = false;
+            if (!warned)
+                std::cerr << "Cannot drop the page cache (needs root on Linux), only syncing" << std::endl;
+            warned = true;
+        }
+        if (f)
+            fclose(f);
+    }
+}
+
+// Runs the child with stdout silenced and returns its metrics in reported order
+std::vector<std::pair<std::string, double>> spawn_run(const std::string &exe, std::vector<std::string> args) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("pipe() failed");
+    args.push_back("--report-fd=" + std::to_string(fds[1]));
+
+    pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("fork() failed");
+    if (pid == 0) {
+        close(fds[0]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0)
+            dup2(null_fd, STDOUT_FILENO);
+        std::vector<char *> argv;
+        argv.push_back(const_cast<char *>(exe.c_str()));
+        for (auto &arg : args)
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(exe.c_str(), argv.data());
+        _exit(127);
+    }
+
+    close(fds[1]);
+    std::string text;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fds[0], chunk, sizeof(chunk))) > 0)
+        text.append(chunk, size_t(n));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("Benchmark child failed: " + args[args.size() - 2]);
+
+    std::vector<std::pair<std::string, double>> metrics;
+    std::istringstream in(text);
+    std::string key;
+    double value;
+    while (in >> key >> value)
+        metrics.push_back({key, value});
+    return metrics;
+}
+
+// Two-sided 95% Student-t critical value for df degrees of freedom
+double t_critical_95(int df) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1)
+        return 0;
+    return df <= 30 ? table[df - 1] : 1.96;
+}
+
+struct metric_summary {
+    std::vector<double> samples;
+    double mean = 0;
+    double stddev = 0;
+    double ci95 = 0;    // half-width of the 95% confidence interval of the mean
+};
+
+metric_summary summarize(const std::vector<double> &samples) {
+    metric_summary s;
+    s.samples = samples;
+    for (double v : samples)
+        s.mean += v;
+    s.mean /= double(samples.size());
+    if (samples.size() > 1) {
+        double sq = 0;
+        for (double v : samples)
+            sq += (v - s.mean) * (v - s.mean);
+        s.stddev = std::sqrt(sq / double(samples.size() - 1));
+        s.ci95 = t_critical_95(int(samples.size()) - 1) * s.stddev / std::sqrt(double(samples.size()));
+    }
+    return s;
+}
+
+struct backend_summary {
+    std::string name;
+    std::vector<std::pair<std::string, metric_summary>> metrics;
+};
+
+void write_json(const std::string &path, const bench_config &config, const repeat_spec &repeat, const std::vector<backend_summary> &results) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("Failed to open " + path);
+    out << std::setprecision(10);
+    out << "{\n  \"config\": {\"messages\": " << config.howmany << ", \"threads\": " << config.thread_count << ", \"queue_size\": "
+        << config.queue_size << ", \"workers\": " << config.async_workers << ", \"warmup\": " << repeat.warmup
+        << ", \"repetitions\": " << repeat.repetitions << "},\n  \"results\": [";
+    for (size_t b = 0; b < results.size(); b++) {
+        out << (b ? "," : "") << "\n    {\"backend\": \"" << results[b].name << "\", \"metrics\": {";
+        for (size_t m = 0; m < results[b].metrics.size(); m++) {
+            const metric_summary &s = results[b].metrics[m].second;
+            out << (m ? "," : "") << "\n      \"" << results[b].metrics[m].first << "\": {\"mean\": " << s.mean << ", \"stddev\": " << s.stddev
+                << ", \"ci95\": " << s.ci95 << ", \"samples\": [";
+            for (size_t i = 0; i < s.samples.size(); i++)
+                out << (i ? ", " : "") << s.samples[i];
+            out << "]}";
+        }
+        out << "\n    }}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void write_csv(const std::string &path, const std::vector<backend_summary> &results) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("Failed to open " + path);
+    out << std::setprecision(10);
+    out << "backend,metric,n,mean,stddev,ci95_low,ci95_high" << std::endl;
+    for (auto &b : results)
+        for (auto &m : b.metrics)
+            out << b.name << "," << m.first << "," << m.second.samples.size() << "," << m.second.mean << "," << m.second.stddev << ","
+                << m.second.mean - m.second.ci95 << "," << m.second.mean + m.second.ci95 << std::endl;
+}
+
+// Parent side. child_args are this process's own arguments minus the runner's options
+// and --backends; each child gets a single backend and a pipe to report on.
+void run_repeated(const repeat_spec &repeat, const std::vector<std::string> &names, const bench_config &config, const std::string &exe,
+                  const std::vector<std::string> &child_args) {
+    std::vector<backend_summary> results;
+    for (auto *entry : select_backends(names)) {
+        std::vector<std::string> args = child_args;
+        args.push_back(std::string("--backends=") + entry->name);
+
+        std::vector<std::string> order;
+        std::map<std::string, std::vector<double>> samples;
+        for (int i = 0; i < repeat.warmup + repeat.repetitions; i++) {
+            settle_between_runs(repeat.between);
+            std::vector<std::pair<std::string, double>> metrics = spawn_run(exe, args);
+            if (i < repeat.warmup)
+                continue;
+            for (auto &metric : metrics) {
+                if (!samples.count(metric.first))
+                    order.push_back(metric.first);
+                samples[metric.first].push_back(metric.second);
+            }
+        }
+
+        backend_summary summary;
+        summary.name = entry->name;
+        std::cout << entry->name << " (" << repeat.repetitions << " runs after " << repeat.warmup << " warmup, mean +- 95% CI, stddev)" << std::endl;
+        for (auto &key : order) {
+            metric_summary s = summarize(samples[key]);
+            std::cout << "  " << std::left << std::setw(26) << key << std::right << std::setw(16) << std::fixed << std::setprecision(2) << s.mean
+                      << " +- " << std::setw(12) << s.ci95 << "  sd " << s.stddev << std::defaultfloat << std::endl;
+            summary.metrics.push_back({key, s});
+        }
+        std::cout << std::endl;
+        results.push_back(summary);
+    }
+
+    if (!repeat.json_path.empty())
+        write_json(repeat.json_path, config, repeat, results);
+    if (!repeat.csv_path.empty())
+        write_csv(repeat.csv_path, results);
+}
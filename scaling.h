@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+#include "bench_driver.h"
+
+// --scaling: every backend at 1, 2, 4, ... max_threads producers with the same total
+// record count, printed as a throughput and p99 curve against the producer count
+struct scaling_spec {
+    bool enabled = false;
+    int max_threads = int(std::max(std::thread::hardware_concurrency(), 1u));
+};
+
+// Applies a --scaling / --max-threads option; false if arg is not one
+bool parse_scaling_option(const std::string &arg, scaling_spec &spec) {
+    if (arg == "--scaling")
+        spec.enabled = true;
+    else if (arg.rfind("--max-threads=", 0) == 0)
+        spec.max_threads = std::max(atoi(arg.c_str() + 14), 1);
+    else
+        return false;
+    return true;
+}
+
+// Producer counts of the curve: powers of two, plus max_threads itself
+std::vector<int> scaling_steps(int max_threads) {
+    std::vector<int> steps;
+    for (int n = 1; n < max_threads; n *= 2)
+        steps.push_back(n);
+    steps.push_back(max_threads);
+    return steps;
+}
+
+// Efficiency is throughput per producer relative to the single-producer run; 100% means
+// perfectly linear scaling, which a shared output file will rarely reach.
+void run_thread_scaling(const scaling_spec &scaling, const std::vector<std::string> &names, bench_config config) {
+    std::cout << "CPUs: " << cpu_topology().size() << " allowed on " << numa_node_count() << " NUMA node(s), pinning "
+              << affinity_mode_name(config.affinity) << std::endl;
+    std::cout << std::left << std::setw(14) << "backend" << std::right << std::setw(9) << "threads" << std::setw(14) << "records/sec"
+              << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(12) << "p99 ns" << std::setw(14) << "max ns"
+              << "  producer CPUs" << std::endl;
+
+    for (auto *entry : select_backends(names)) {
+        double single = 0;
+        for (int threads : scaling_steps(scaling.max_threads)) {
+            config.thread_count = threads;
+            auto backend = entry->create();
+            bench_result r = run_backend(*backend, config);
+            auto ns = [](uint64_t ticks) { return uint64_t(double(ticks) * latency_ns_per_tick); };
+
+            double rate = r.records / r.elapsed_secs;
+            if (threads == 1)
+                single = rate;
+            double speedup = single > 0 ? rate / single : 0;
+
+            std::string cpus;
+            for (int cpu : r.placement.producers)
+                cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+            std::cout << std::left << std::setw(14) << r.name << std::right << std::setw(9) << threads << std::setw(14) << uint64_t(rate)
+                      << std::setw(10) << std::fixed << std::setprecision(2) << speedup << std::setw(11) << std::setprecision(1)
+                      << speedup / threads * 100 << "%" << std::setw(12) << ns(r.latency.percentile(0.99)) << std::setw(14)
+                      << ns(r.latency.max()) << "  " << (cpus.empty() ? "-" : cpus) << std::defaultfloat << std::endl;
+        }
+    }
+}
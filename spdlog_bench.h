@@ -1,59 +1,168 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/details/file_helper.h>
+#include <unistd.h>
+
 #include <iostream>
 
+#include "bench_backend.h"
+#include "io_accounting.h"
+#include "rotation.h"
+
 using namespace std;
 using namespace std::chrono;
 using namespace spdlog;
 using namespace spdlog::sinks;
 
-void spdlog_thread_fun(std::shared_ptr<spdlog::logger> logger, int howmany) {
-    for (int i = 0; i < howmany; i++) {
-        logger->info("Hello logger: msg number x");
-        
-        // logger->info("Hello logger: msg number {}", 1.23);
+// Same as spdlog's basic_file_sink, but also counts the formatted bytes it writes
+template <typename Mutex>
+class counting_file_sink : public spdlog::sinks::base_sink<Mutex> {
+public:
+    counting_file_sink(const spdlog::filename_t &filename, std::shared_ptr<io_counter> counter)
+        : counter_(std::move(counter)) {
+        file_helper_.open(filename, true);
+    }
+
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override {
+        spdlog::memory_buf_t formatted;
+        this->formatter_->format(msg, formatted);
+        file_helper_.write(formatted);
+        counter_->bytes.fetch_add(formatted.size(), std::memory_order_relaxed);
+        counter_->records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush_() override { file_helper_.flush(); }
+
+private:
+    spdlog::details::file_helper file_helper_;
+    std::shared_ptr<io_counter> counter_;
+};
+
+// Formats like any spdlog sink and hands the bytes to one of the shared output sinks
+template <typename Mutex>
+class output_sink_adapter : public spdlog::sinks::base_sink<Mutex> {
+public:
+    output_sink_adapter(std::unique_ptr<output_sink> out, std::shared_ptr<io_counter> counter)
+        : out_(std::move(out)), counter_(std::move(counter)) {}
+
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override {
+        spdlog::memory_buf_t formatted;
+        this->formatter_->format(msg, formatted);
+        out_->write(formatted.data(), formatted.size());
+        counter_->bytes.fetch_add(formatted.size(), std::memory_order_relaxed);
+        counter_->records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush_() override { out_->flush(); }
+
+private:
+    std::unique_ptr<output_sink> out_;
+    std::shared_ptr<io_counter> counter_;
+};
+
+class spdlog_sync_backend : public logger_backend {
+public:
+    const char *name() const override { return "spdlog_sync"; }
+    const char *title() const override { return "Spdlog: Sync Log"; }
+    // rotating_file_sink counts nothing, but reports each file's size as it closes it
+    int64_t bytes_written() const override { return rotating_ ? int64_t(rotation_log.bytes()) : int64_t(counter_->bytes.load()); }
+    int64_t records_written() const override { return rotating_ ? -1 : int64_t(counter_->records.load()); }
+    std::string output_path() const override { return path_; }
+    bool supports_rotation() const override { return true; }
 
-        // double floating_number = 3.14;
-        // logger->info("Hello logger: msg number {}", floating_number);
+    void setup(const bench_config &config) override {
+        pattern_ = config.work->format_pattern();
+        auto sinks = make_sinks(config, config.log_dir + "/spdlog_sync_log.txt");
+        logger_ = std::make_shared<spdlog::logger>("spdlog_sync_logger", sinks.begin(), sinks.end());
+        spdlog::register_logger(logger_);
+        logger_->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v");
+    }
 
-        // logger->info("0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789");
+    void log_one(const log_record &rec) override {
+        spdlog::level::level_enum level = spdlog_level(rec.level);
+        if (rec.nargs == 0) {
+            logger_->log(level, spdlog::string_view_t(rec.text, rec.text_size));
+            return;
+        }
+        with_record_args(rec, [&](spdlog::string_view_t text, const auto &...args) {
+            logger_->log(level, SPDLOG_FMT_RUNTIME(pattern_), text, args...);
+        });
     }
-}
 
-void spdlog_mt(int howmany, std::shared_ptr<spdlog::logger> logger, int thread_count) {
-    using std::chrono::high_resolution_clock;
-    std::vector<std::thread> threads;
-    auto start = high_resolution_clock::now();
+    void flush() override { logger_->flush(); }
+
+    void teardown() override {
+        logger_.reset();
+        spdlog::drop("spdlog_sync_logger");
+    }
 
-    int msgs_per_thread = howmany / thread_count;
-    int msgs_per_thread_mod = howmany % thread_count;
-    for (int t = 0; t < thread_count; ++t) {
-        if (t == 0 && msgs_per_thread_mod)
-            threads.push_back(
-                std::thread(spdlog_thread_fun, logger, msgs_per_thread + msgs_per_thread_mod));
+protected:
+    // The file sink first: basic_file_sink's behaviour for sink_native, rotating_file_sink
+    // with --rotate, the shared output sink otherwise. Then the --fanout socket sinks.
+    std::vector<spdlog::sink_ptr> make_sinks(const bench_config &config, const std::string &path) {
+        path_ = sink_output_path(config.sink, path);
+        rotating_ = config.rotate_bytes > 0;
+        std::vector<spdlog::sink_ptr> sinks;
+        if (rotating_) {
+            // rotating_file_sink appends to an existing base file, so start from nothing
+            for (int i = 0; i <= rotation_max_files; i++)
+                unlink(spdlog::sinks::rotating_file_sink<std::mutex>::calc_filename(path, size_t(i)).c_str());
+            spdlog::file_event_handlers handlers;
+            handlers.after_open = [](const spdlog::filename_t &, std::FILE *) { rotation_log.file_opened(); };
+            handlers.before_close = [](const spdlog::filename_t &, std::FILE *file) { rotation_log.file_closed(uint64_t(ftell(file))); };
+            sinks.push_back(std::make_shared<spdlog::sinks::rotating_file_sink<std::mutex>>(path, size_t(config.rotate_bytes), rotation_max_files,
+                                                                                            false, handlers));
+        }
+        else if (auto out = make_backend_sink(config, path))
+            sinks.push_back(std::make_shared<output_sink_adapter<std::mutex>>(std::move(out), counter_));
         else
-            threads.push_back(std::thread(spdlog_thread_fun, logger, msgs_per_thread));
-    }
-
-    for (auto &t : threads) {
-        t.join();
-    };
-
-    auto delta = high_resolution_clock::now() - start;
-    auto delta_d = duration_cast<duration<double>>(delta).count();
-    std::cout << "Elapsed: " << delta_d << "secs\t" << int(howmany / delta_d) * (70+74) / 1024 /1024  << " MB/sec" << std::endl << std::endl;
-}
-
-void spdlog_sync_bench(int howmany, int threads) {
-    auto spdlog_sync_logger = spdlog::basic_logger_mt("spdlog_sync_logger", "/Users/jimmyliu/VSCodeProjects/log_analysist_tool/build/logs/spdlog_sync_log.txt", true);
-    spdlog_sync_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v");
-    spdlog_mt(howmany, std::move(spdlog_sync_logger), threads);
-}
-
-void spdlog_async_bench(int howmany, int threads, int queue_size) {
-    spdlog::init_thread_pool(queue_size, 1);    // 设置异步缓存队列大小
-    auto spdlog_async_logger = spdlog::basic_logger_mt<spdlog::async_factory>("async_file_logger", "/Users/jimmyliu/VSCodeProjects/log_analysist_tool/build/logs/spdlog_async_log.txt", true);
-    spdlog_async_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v");
-    spdlog_mt(howmany, std::move(spdlog_async_logger), threads);
-}
\ No newline at end of file
+            sinks.push_back(std::make_shared<counting_file_sink<std::mutex>>(path, counter_));
+        for (int i = 1; i < config.fanout; i++)
+            sinks.push_back(std::make_shared<output_sink_adapter<std::mutex>>(std::unique_ptr<output_sink>(new socket_output_sink()),
+                                                                              std::make_shared<io_counter>()));
+        return sinks;
+    }
+
+    static spdlog::level::level_enum spdlog_level(int level) {
+        static const spdlog::level::level_enum levels[] = {spdlog::level::debug, spdlog::level::info, spdlog::level::warn, spdlog::level::err};
+        return levels[level];
+    }
+
+    std::shared_ptr<spdlog::logger> logger_;
+    std::shared_ptr<io_counter> counter_ = std::make_shared<io_counter>();
+    std::string pattern_;
+    std::string path_;
+    bool rotating_ = false;
+};
+
+class spdlog_async_backend : public spdlog_sync_backend {
+public:
+    const char *name() const override { return "spdlog_async"; }
+    const char *title() const override { return "Spdlog: Async Log"; }
+    bool is_async() const override { return true; }
+    bool uses_async_workers() const override { return true; }
+
+    void setup(const bench_config &config) override {
+        pattern_ = config.work->format_pattern();
+        spdlog::init_thread_pool(config.queue_size, config.async_workers);    // 设置异步缓存队列大小
+        auto policy = config.overflow == overflow_drop ? spdlog::async_overflow_policy::overrun_oldest : spdlog::async_overflow_policy::block;
+        auto sinks = make_sinks(config, config.log_dir + "/spdlog_async_log.txt");
+        logger_ = std::make_shared<spdlog::async_logger>("async_file_logger", sinks.begin(), sinks.end(), spdlog::thread_pool(), policy);
+        spdlog::register_logger(logger_);
+        logger_->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] <%t>  %v");
+    }
+
+    void teardown() override {
+        // Destroying the thread pool drains the queue and joins the worker
+        logger_.reset();
+        spdlog::shutdown();
+    }
+};
+
+REGISTER_LOGGER_BACKEND(spdlog_sync_backend)
+REGISTER_LOGGER_BACKEND(spdlog_async_backend)
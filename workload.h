@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Records below log_threshold are generated but expected to be filtered out by every backend
+enum log_level { level_debug = 0, level_info, level_warn, level_error, level_count };
+const log_level log_threshold = level_info;
+
+// One logging argument. A single argument type lets every library log a record with
+// any mix of integers, floats and strings through the same call shape.
+struct bench_arg {
+    enum kind_t : uint8_t { integer, floating, string } kind;
+    union {
+        int64_t i;
+        double d;
+        struct {
+            const char *data;
+            uint32_t size;
+        } s;
+    };
+};
+
+inline std::ostream &operator<<(std::ostream &os, const bench_arg &arg) {
+    switch (arg.kind) {
+    case bench_arg::integer: return os << arg.i;
+    case bench_arg::floating: return os << arg.d;
+    default: return os.write(arg.s.data, arg.s.size);
+    }
+}
+
+// Floats as "{:g}", the same 6 significant digits an ostream prints by default, so the
+// fmt-based and the ostream-based backends write identical text
+template <>
+struct fmt::formatter<bench_arg> {
+    constexpr auto parse(format_parse_context &ctx) -> decltype(ctx.begin()) { return ctx.begin(); }
+
+    template <typename FormatContext>
+    auto format(const bench_arg &arg, FormatContext &ctx) const -> decltype(ctx.out()) {
+        switch (arg.kind) {
+        case bench_arg::integer: return fmt::format_to(ctx.out(), "{}", arg.i);
+        case bench_arg::floating: return fmt::format_to(ctx.out(), "{:g}", arg.d);
+        default: return fmt::format_to(ctx.out(), "{}", fmt::string_view(arg.s.data, arg.s.size));
+        }
+    }
+};
+
+// Message body text, followed by args[0..nargs) separated by spaces
+struct log_record {
+    const char *text;
+    uint32_t text_size;
+    uint8_t level;
+    uint8_t nargs;
+    const bench_arg *args;
+};
+
+struct workload_spec {
+    static const int max_args = 8;
+
+    int int_args = 0;
+    int float_args = 0;
+    int string_args = 0;
+    // Body text length is drawn uniformly from [min_size, max_size]
+    int min_size = 26;
+    int max_size = 26;
+    // Relative weights of debug / info / warn / error records
+    double level_weights[level_count] = {0, 1, 0, 0};
+    uint32_t seed = 42;
+
+    int nargs() const { return int_args + float_args + string_args; }
+};
+
+// Applies a --ints / --floats / --strings / --msg-size / --levels / --seed option; false if arg is not one
+bool parse_workload_option(const std::string &arg, workload_spec &spec) {
+    auto value = [&](const char *prefix) -> const char * {
+        size_t n = strlen(prefix);
+        return arg.compare(0, n, prefix) == 0 ? arg.c_str() + n : nullptr;
+    };
+
+    if (const char *v = value("--ints="))
+        spec.int_args = atoi(v);
+    else if (const char *v = value("--floats="))
+        spec.float_args = atoi(v);
+    else if (const char *v = value("--strings="))
+        spec.string_args = atoi(v);
+    else if (const char *v = value("--seed="))
+        spec.seed = uint32_t(strtoul(v, nullptr, 10));
+    else if (const char *v = value("--msg-size=")) {
+        spec.min_size = spec.max_size = atoi(v);
+        if (const char *dash = strchr(v, '-'))
+            spec.max_size = atoi(dash + 1);
+    }
+    else if (const char *v = value("--levels=")) {
+        for (int l = 0; l < level_count; l++) {
+            spec.level_weights[l] = atof(v);
+            v = strchr(v, ',');
+            if (!v)
+                break;
+            v++;
+        }
+    }
+    else
+        return false;
+
+    if (spec.int_args < 0 || spec.float_args < 0 || spec.string_args < 0)
+        throw std::runtime_error("--ints, --floats and --strings cannot be negative");
+    if (spec.nargs() > workload_spec::max_args)
+        throw std::runtime_error("At most 8 arguments per record are supported");
+    if (spec.min_size < 1 || spec.max_size < spec.min_size)
+        throw std::runtime_error("Bad --msg-size range");
+    double total_weight = 0;
+    for (int l = 0; l < level_count; l++) {
+        if (spec.level_weights[l] < 0)
+            throw std::runtime_error("--levels weights cannot be negative");
+        total_weight += spec.level_weights[l];
+    }
+    if (total_weight <= 0)
+        throw std::runtime_error("--levels needs at least one non-zero weight");
+    return true;
+}
+
+// The full record stream for one run, generated up front so that every backend
+// logs exactly the same sequence and generation cost stays out of the timed loop.
+class workload {
+public:
+    workload(const workload_spec &spec, int howmany) : spec_(spec) {
+        std::mt19937 rng(spec.seed);
+
+        text_pool_ = "Hello logger: msg number x";
+        while (int(text_pool_.size()) < spec.max_size)
+            text_pool_ += " 0123456789abcdefghijklmnopqrstuvwxyz";
+
+        static const char *const words[] = {"ok", "user", "session", "request_id", "/api/v1/orders", "timeout",
+                                            "connection reset by peer", "cache-miss", "shard-07", "GET"};
+        const int word_count = sizeof(words) / sizeof(words[0]);
+
+        std::uniform_int_distribution<int> size_dist(spec.min_size, spec.max_size);
+        std::discrete_distribution<int> level_dist(spec.level_weights, spec.level_weights + level_count);
+        std::uniform_int_distribution<int64_t> int_dist(-1000000, 100000000);
+        std::uniform_real_distribution<double> float_dist(0.0, 10000.0);
+        std::uniform_int_distribution<int> word_dist(0, word_count - 1);
+
+        int nargs = spec.nargs();
+        format_pattern_ = "{}";
+        for (int i = 0; i < nargs; i++)
+            format_pattern_ += " {}";
+
+        args_.resize(size_t(howmany) * nargs);
+        records_.resize(howmany);
+        enabled_before_.assign(size_t(howmany) + 1, 0);
+        payload_before_.assign(size_t(howmany) + 1, 0);
+        for (int r = 0; r < howmany; r++) {
+            log_record &rec = records_[r];
+            rec.text = text_pool_.data();
+            rec.text_size = uint32_t(size_dist(rng));
+            rec.level = uint8_t(level_dist(rng));
+            rec.nargs = uint8_t(nargs);
+            rec.args = args_.data() + size_t(r) * nargs;
+
+            bench_arg *a = &args_[size_t(r) * nargs];
+            for (int i = 0; i < spec.int_args; i++, a++) {
+                a->kind = bench_arg::integer;
+                a->i = int_dist(rng);
+            }
+            for (int i = 0; i < spec.float_args; i++, a++) {
+                a->kind = bench_arg::floating;
+                a->d = float_dist(rng);
+            }
+            for (int i = 0; i < spec.string_args; i++, a++) {
+                const char *w = words[word_dist(rng)];
+                a->kind = bench_arg::string;
+                a->s.data = w;
+                a->s.size = uint32_t(strlen(w));
+            }
+
+            if (rec.level >= log_threshold) {
+                enabled_++;
+                payload_bytes_ += rec.text_size;
+                for (int i = 0; i < nargs; i++)
+                    payload_bytes_ += 1 + fmt::formatted_size("{}", rec.args[i]);
+            }
+            enabled_before_[r + 1] = enabled_;
+            payload_before_[r + 1] = payload_bytes_;
+        }
+    }
+
+    const workload_spec &spec() const { return spec_; }
+    // fmt pattern matching with_record_args(): the text plus one "{}" per argument
+    const std::string &format_pattern() const { return format_pattern_; }
+    const log_record *records() const { return records_.data(); }
+    int size() const { return int(records_.size()); }
+    // Records at or above log_threshold
+    uint64_t enabled() const { return enabled_; }
+    // Formatted message bytes of the enabled records, excluding each library's line prefix
+    uint64_t payload_bytes() const { return payload_bytes_; }
+    // Same as enabled() / payload_bytes() for a run that logs only the first n records
+    uint64_t enabled(int n) const { return enabled_before_[n]; }
+    uint64_t payload_bytes(int n) const { return payload_before_[n]; }
+
+private:
+    workload_spec spec_;
+    std::string text_pool_;
+    std::string format_pattern_;
+    std::vector<bench_arg> args_;
+    std::vector<log_record> records_;
+    std::vector<uint64_t> enabled_before_;
+    std::vector<uint64_t> payload_before_;
+    uint64_t enabled_ = 0;
+    uint64_t payload_bytes_ = 0;
+};
+
+// Calls log(args...) with the record's text followed by its arguments. Used by the
+// fmt-based backends, whose call sites need the argument count at compile time.
+template <typename F>
+void with_record_args(const log_record &rec, F &&log) {
+    fmt::string_view text(rec.text, rec.text_size);
+    const bench_arg *a = rec.args;
+    switch (rec.nargs) {
+    case 0: log(text); break;
+    case 1: log(text, a[0]); break;
+    case 2: log(text, a[0], a[1]); break;
+    case 3: log(text, a[0], a[1], a[2]); break;
+    case 4: log(text, a[0], a[1], a[2], a[3]); break;
+    case 5: log(text, a[0], a[1], a[2], a[3], a[4]); break;
+    case 6: log(text, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 7: log(text, a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    default: log(text, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]); break;
+    }
+}
+
+// Writes the record's text and arguments to a stream, for the ostream-based backends
+inline std::ostream &operator<<(std::ostream &os, const log_record &rec) {
+    os.write(rec.text, rec.text_size);
+    for (int i = 0; i < rec.nargs; i++)
+        os << ' ' << rec.args[i];
+    return os;
+}